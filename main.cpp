@@ -5,17 +5,180 @@
 #include <fstream>
  
 #include <vector>
+#include <array>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <json.hpp>
 #include <ctime>
 #include <iomanip>
-#include "tabulate.hpp"
-using namespace tabulate;
+#include <chrono>
+#include <random>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <climits>
+#include <limits>
+#include <new>
+#include <cmath>
+#include <memory>
+#include <tuple>
+#include <numeric>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 using json = nlohmann::json;
+namespace fs = std::filesystem;
 
 const std::string SETTINGS_FILE = "../../settings.json";
 const std::string DAYS_OFF_FILE = "../../days_off.json";
+const std::string HOLIDAYS_FILE = "../../usholidays.json";
+
+// Heap allocations made through operator new on this thread, counted so benchmarks and
+// --profile can report allocations. Replacing the global operator new costs one increment.
+thread_local uint64_t thread_heap_allocations = 0;
+
+void* operator new(std::size_t size) {
+	thread_heap_allocations++;
+	if (void* p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	thread_heap_allocations++;
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+	return ::operator new(size, tag);
+}
+
+// Kept out of line: once inlined into callers, GCC sees free() on operator new's result and
+// warns about a mismatched pair
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void release_heap_block(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p) noexcept {
+	release_heap_block(p);
+}
+
+void operator delete[](void* p) noexcept {
+	release_heap_block(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	release_heap_block(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	release_heap_block(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	release_heap_block(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	release_heap_block(p);
+}
+
+// Phases that --profile reports time and allocations for
+enum class Phase { Load, Parse, Compute, Render, Save };
+
+const char* const PHASE_NAMES[] = { "load", "parse", "compute", "render", "save" };
+const size_t PHASE_COUNT = sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]);
+
+// Set once from main before any worker starts; while false a ScopedPhase is one branch
+bool profiling_enabled = false;
+
+struct PhaseTotals {
+	std::atomic<uint64_t> nanoseconds{ 0 };
+	std::atomic<uint64_t> allocations{ 0 };
+	std::atomic<uint64_t> calls{ 0 };
+};
+
+PhaseTotals phase_totals[PHASE_COUNT];
+
+// Charges the time and allocations of a scope to a phase when profiling. Scopes nest: a
+// phase is charged only for what its inner phases did not claim, so the phases add up to the
+// work done. Worker threads add into the same totals.
+class ScopedPhase {
+public:
+	explicit ScopedPhase(Phase phase) {
+		if (!profiling_enabled) {
+			return;
+		}
+		phase_ = static_cast<size_t>(phase);
+		parent_ = current_;
+		current_ = this;
+		allocations_ = thread_heap_allocations;
+		start_ = std::chrono::steady_clock::now();
+	}
+
+	~ScopedPhase() {
+		if (phase_ == SIZE_MAX) {
+			return;
+		}
+		uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+		uint64_t allocated = thread_heap_allocations - allocations_;
+		PhaseTotals& totals = phase_totals[phase_];
+		totals.nanoseconds += elapsed - child_nanoseconds_;
+		totals.allocations += allocated - child_allocations_;
+		totals.calls++;
+		current_ = parent_;
+		if (parent_) {
+			parent_->child_nanoseconds_ += elapsed;
+			parent_->child_allocations_ += allocated;
+		}
+	}
+
+	ScopedPhase(const ScopedPhase&) = delete;
+	ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+	static thread_local ScopedPhase* current_;
+
+	size_t phase_ = SIZE_MAX;
+	ScopedPhase* parent_ = nullptr;
+	std::chrono::steady_clock::time_point start_;
+	uint64_t allocations_ = 0;
+	uint64_t child_nanoseconds_ = 0;
+	uint64_t child_allocations_ = 0;
+};
+
+thread_local ScopedPhase* ScopedPhase::current_ = nullptr;
 
 // Formats hours as a string, converting to days and remaining hours if hours > 8
 std::string format_hrs(double hours) {
@@ -33,366 +196,5613 @@ std::string format_hrs(double hours) {
     return oss.str();
 }
 
-static bool entry_exists(const nlohmann::json& days_off, const std::string& key, const std::string& date) {
-	for (const auto& entry : days_off) {
-		if (entry.contains(key) && entry[key] == date) {
-			return true;
+// Calendar engine: dates are handled as integer day numbers (days since 1970-01-01)
+// so weekday counts are closed-form instead of stepping a time_t one day at a time.
+
+// Day number of a proleptic Gregorian date (Howard Hinnant's days_from_civil)
+constexpr int days_from_civil(int y, unsigned m, unsigned d) {
+	y -= m <= 2;
+	const int era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = static_cast<unsigned>(y - era * 400);
+	const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<int>(doe) - 719468;
+}
+
+struct CivilYmd {
+	int year;
+	unsigned month;
+	unsigned day;
+};
+
+// Inverse of days_from_civil
+constexpr CivilYmd civil_from_days(int z) {
+	z += 719468;
+	const int era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned doe = static_cast<unsigned>(z - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+	const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+	return { static_cast<int>(yoe) + era * 400 + (m <= 2), m, d };
+}
+
+constexpr bool is_leap_year(int y) {
+	return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+constexpr unsigned days_in_month(int y, unsigned m) {
+	return m == 2 ? (is_leap_year(y) ? 29u : 28u) : ((m == 4 || m == 6 || m == 9 || m == 11) ? 30u : 31u);
+}
+
+// A calendar date with no time of day or time zone, stored as days since 1970-01-01
+struct Date {
+	int32_t days = 0;
+
+	constexpr Date() = default;
+	constexpr explicit Date(int32_t day_number) : days(day_number) {}
+
+	static constexpr Date from_ymd(int y, unsigned m, unsigned d) {
+		return Date(days_from_civil(y, m, d));
+	}
+
+	// Parses YYYY-MM-DD (month and day may be a single digit), throws on anything else
+	static Date parse(const std::string& date_str) {
+		const char* p = date_str.c_str();
+		const char* end = p + date_str.size();
+		auto read_number = [&](int min_digits, int max_digits, int& out) {
+			int digits = 0;
+			out = 0;
+			while (p != end && digits < max_digits && *p >= '0' && *p <= '9') {
+				out = out * 10 + (*p++ - '0');
+				digits++;
+			}
+			return digits >= min_digits;
+		};
+		int y = 0, m = 0, d = 0;
+		bool ok = read_number(4, 4, y) && p != end && *p++ == '-' &&
+			read_number(1, 2, m) && p != end && *p++ == '-' &&
+			read_number(1, 2, d) && p == end &&
+			m >= 1 && m <= 12 && d >= 1 && static_cast<unsigned>(d) <= days_in_month(y, static_cast<unsigned>(m));
+		if (!ok) {
+			throw std::runtime_error("Invalid date format. Use YYYY-MM-DD.");
+		}
+		return from_ymd(y, static_cast<unsigned>(m), static_cast<unsigned>(d));
+	}
+
+	constexpr CivilYmd ymd() const { return civil_from_days(days); }
+	constexpr int year() const { return civil_from_days(days).year; }
+	constexpr unsigned month() const { return civil_from_days(days).month; }
+	constexpr unsigned day() const { return civil_from_days(days).day; }
+
+	// 0 = Sunday ... 6 = Saturday
+	constexpr int weekday() const {
+		return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+	}
+
+	std::string to_string() const {
+		CivilYmd c = ymd();
+		char buf[11];
+		unsigned y = static_cast<unsigned>(c.year);
+		buf[0] = static_cast<char>('0' + y / 1000 % 10);
+		buf[1] = static_cast<char>('0' + y / 100 % 10);
+		buf[2] = static_cast<char>('0' + y / 10 % 10);
+		buf[3] = static_cast<char>('0' + y % 10);
+		buf[4] = '-';
+		buf[5] = static_cast<char>('0' + c.month / 10);
+		buf[6] = static_cast<char>('0' + c.month % 10);
+		buf[7] = '-';
+		buf[8] = static_cast<char>('0' + c.day / 10);
+		buf[9] = static_cast<char>('0' + c.day % 10);
+		buf[10] = '\0';
+		return std::string(buf, 10);
+	}
+
+	constexpr Date operator+(int n) const { return Date(days + n); }
+	constexpr Date operator-(int n) const { return Date(days - n); }
+	constexpr int operator-(Date other) const { return days - other.days; }
+	Date& operator++() { ++days; return *this; }
+	constexpr bool operator==(Date other) const { return days == other.days; }
+	constexpr bool operator!=(Date other) const { return days != other.days; }
+	constexpr bool operator<(Date other) const { return days < other.days; }
+	constexpr bool operator<=(Date other) const { return days <= other.days; }
+	constexpr bool operator>(Date other) const { return days > other.days; }
+	constexpr bool operator>=(Date other) const { return days >= other.days; }
+};
+
+static_assert(sizeof(Date) == 4, "Date should stay a 4-byte day number");
+static_assert(Date::from_ymd(1970, 1, 1).days == 0, "epoch");
+static_assert(Date::from_ymd(2025, 6, 9).weekday() == 1, "2025-06-09 is a Monday");
+static_assert(Date(20248).year() == 2025 && Date(20248).month() == 6 && Date(20248).day() == 9, "round trip");
+
+// The date all "as of today" math uses. This is the only place the time zone is consulted:
+// the host clock is read on first use, or PTO_TODAY=YYYY-MM-DD pins it for reproducible runs.
+Date today() {
+	static const char* pinned = std::getenv("PTO_TODAY");
+	if (pinned && *pinned) {
+		static const Date fixed = Date::parse(pinned);
+		return fixed;
+	}
+	// Re-read the time zone at most once a minute, so a long-running server rolls over at
+	// midnight. The minute and the date it gave share one atomic word: worker threads calling
+	// this on every ledger never wait on each other, and a stale word just costs one more
+	// localtime call.
+	static std::atomic<uint64_t> cached{ 0 };
+	std::time_t now = std::time(nullptr);
+	uint64_t minute = static_cast<uint64_t>(now / 60);
+	uint64_t word = cached.load(std::memory_order_relaxed);
+	if (word >> 32 != minute) {
+		std::tm local{};
+#ifdef _WIN32
+		localtime_s(&local, &now);
+#else
+		localtime_r(&now, &local);
+#endif
+		Date date = Date::from_ymd(local.tm_year + 1900, static_cast<unsigned>(local.tm_mon + 1), static_cast<unsigned>(local.tm_mday));
+		word = minute << 32 | static_cast<uint32_t>(date.days);
+		cached.store(word, std::memory_order_relaxed);
+	}
+	return Date(static_cast<int32_t>(static_cast<uint32_t>(word)));
+}
+
+// Number of weekdays in [epoch Monday, day), the Monday being 1969-12-29 (day -3)
+static int weekdays_before(Date day) {
+	int shifted = day.days + 3;
+	int weeks = (shifted >= 0 ? shifted : shifted - 6) / 7;
+	int rem = shifted - weeks * 7;
+	return weeks * 5 + (rem < 5 ? rem : 5);
+}
+
+// Number of Monday-Friday days in [first, last], 0 when the range is empty
+int count_weekdays(Date first, Date last) {
+	if (last < first) {
+		return 0;
+	}
+	return weekdays_before(last + 1) - weekdays_before(first);
+}
+
+bool is_weekday(Date date) {
+	int wday = date.weekday();
+	return wday != 0 && wday != 6; // not Sunday or Saturday
+}
+
+// Number of set bits, for counting business days in calendar words
+inline int popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Holiday rules, expanded into dates for any year instead of hand-maintained yearly lists
+enum class HolidayRuleKind : uint8_t { Fixed, NthWeekday, LastWeekday };
+
+struct HolidayRule {
+	const char* name;
+	HolidayRuleKind kind;
+	unsigned month;
+	unsigned day;      // Fixed: day of the month; NthWeekday: which occurrence (1-5)
+	int weekday;       // 0 = Sunday ... 6 = Saturday, for the weekday kinds
+	bool observed;     // a Saturday holiday is observed Friday, a Sunday one Monday
+	int first_year;    // first year the holiday was observed
+};
+
+constexpr HolidayRule US_FEDERAL_HOLIDAY_RULES[] = {
+	{ "New Year's Day", HolidayRuleKind::Fixed, 1, 1, 0, true, 1870 },
+	{ "Martin Luther King Jr. Day", HolidayRuleKind::NthWeekday, 1, 3, 1, false, 1986 },
+	{ "Presidents' Day", HolidayRuleKind::NthWeekday, 2, 3, 1, false, 1971 },
+	{ "Memorial Day", HolidayRuleKind::LastWeekday, 5, 0, 1, false, 1971 },
+	{ "Juneteenth National Independence Day", HolidayRuleKind::Fixed, 6, 19, 0, true, 2021 },
+	{ "Independence Day", HolidayRuleKind::Fixed, 7, 4, 0, true, 1870 },
+	{ "Labor Day", HolidayRuleKind::NthWeekday, 9, 1, 1, false, 1894 },
+	{ "Columbus Day", HolidayRuleKind::NthWeekday, 10, 2, 1, false, 1971 },
+	{ "Veterans Day", HolidayRuleKind::Fixed, 11, 11, 0, true, 1971 },
+	{ "Thanksgiving Day", HolidayRuleKind::NthWeekday, 11, 4, 4, false, 1942 },
+	{ "Christmas Day", HolidayRuleKind::Fixed, 12, 25, 0, true, 1870 },
+};
+
+// The day a rule's holiday is taken off in a given year, after weekend shifting
+constexpr Date holiday_day_off(const HolidayRule& rule, int year) {
+	Date date;
+	if (rule.kind == HolidayRuleKind::Fixed) {
+		date = Date::from_ymd(year, rule.month, rule.day);
+	}
+	else if (rule.kind == HolidayRuleKind::NthWeekday) {
+		Date first = Date::from_ymd(year, rule.month, 1);
+		date = first + (rule.weekday - first.weekday() + 7) % 7 + 7 * (static_cast<int>(rule.day) - 1);
+	}
+	else {
+		Date last = Date::from_ymd(year, rule.month, days_in_month(year, rule.month));
+		date = last - (last.weekday() - rule.weekday + 7) % 7;
+	}
+	if (rule.observed && date.weekday() == 6) {
+		return date - 1;
+	}
+	if (rule.observed && date.weekday() == 0) {
+		return date + 1;
+	}
+	return date;
+}
+
+static_assert(holiday_day_off(US_FEDERAL_HOLIDAY_RULES[9], 2025) == Date::from_ymd(2025, 11, 27), "Thanksgiving 2025");
+static_assert(holiday_day_off(US_FEDERAL_HOLIDAY_RULES[3], 2025) == Date::from_ymd(2025, 5, 26), "Memorial Day 2025");
+static_assert(holiday_day_off(US_FEDERAL_HOLIDAY_RULES[5], 2026) == Date::from_ymd(2026, 7, 3), "July 4th 2026 is observed Friday");
+static_assert(holiday_day_off(US_FEDERAL_HOLIDAY_RULES[0], 2028) == Date::from_ymd(2027, 12, 31), "New Year's 2028 is observed the Friday before");
+
+// One bit per day of the year, six words per year; set bits are business days
+using CalendarYearBits = std::array<uint64_t, 6>;
+
+// Weekday bits for 64 consecutive days starting on each day of the week
+constexpr std::array<uint64_t, 7> make_weekday_patterns() {
+	std::array<uint64_t, 7> patterns = {};
+	for (int start = 0; start < 7; ++start) {
+		for (int i = 0; i < 64; ++i) {
+			int wday = (start + i) % 7;
+			if (wday != 0 && wday != 6) {
+				patterns[start] |= uint64_t(1) << i;
+			}
+		}
+	}
+	return patterns;
+}
+
+constexpr std::array<uint64_t, 7> WEEKDAY_PATTERNS = make_weekday_patterns();
+
+constexpr void clear_day_bit(CalendarYearBits& bits, int doy) {
+	bits[doy >> 6] &= ~(uint64_t(1) << (doy & 63));
+}
+
+// Business-day bits for a year under a rule set: the weekday pattern with each rule's day
+// off cleared, including one pulled back from next January (an observed New Year's Day)
+constexpr CalendarYearBits build_year_bits(int year, const HolidayRule* rules, size_t rule_count) {
+	CalendarYearBits bits = {};
+	Date jan1 = Date::from_ymd(year, 1, 1);
+	int days = is_leap_year(year) ? 366 : 365;
+	for (int w = 0; w < 6; ++w) {
+		bits[w] = WEEKDAY_PATTERNS[(jan1.weekday() + 64 * w) % 7];
+		if (days - 64 * w < 64) {
+			bits[w] &= (uint64_t(1) << (days - 64 * w)) - 1;
+		}
+	}
+	for (size_t r = 0; r < rule_count; ++r) {
+		for (int y = year; y <= year + 1; ++y) {
+			Date day = holiday_day_off(rules[r], y);
+			if (y >= rules[r].first_year && day.year() == year) {
+				clear_day_bit(bits, day - jan1);
+			}
+		}
+	}
+	return bits;
+}
+
+// Years covered by the compile-time tables: the range forecasts actually ask about
+constexpr int PRECOMPUTED_FIRST_YEAR = 2015;
+constexpr int PRECOMPUTED_LAST_YEAR = 2045;
+using PrecomputedYears = std::array<CalendarYearBits, PRECOMPUTED_LAST_YEAR - PRECOMPUTED_FIRST_YEAR + 1>;
+
+constexpr PrecomputedYears precompute_years(const HolidayRule* rules, size_t rule_count) {
+	PrecomputedYears years = {};
+	for (int year = PRECOMPUTED_FIRST_YEAR; year <= PRECOMPUTED_LAST_YEAR; ++year) {
+		years[year - PRECOMPUTED_FIRST_YEAR] = build_year_bits(year, rules, rule_count);
+	}
+	return years;
+}
+
+constexpr PrecomputedYears US_FEDERAL_YEARS = precompute_years(US_FEDERAL_HOLIDAY_RULES, std::size(US_FEDERAL_HOLIDAY_RULES));
+constexpr PrecomputedYears WEEKEND_ONLY_YEARS = precompute_years(nullptr, 0);
+
+// A named holiday calendar, selected with "holiday_rules" in settings
+struct HolidayRuleSet {
+	const char* name;
+	const HolidayRule* rules;
+	size_t rule_count;
+	const PrecomputedYears* precomputed;
+};
+
+const HolidayRuleSet HOLIDAY_RULE_SETS[] = {
+	{ "us_federal", US_FEDERAL_HOLIDAY_RULES, std::size(US_FEDERAL_HOLIDAY_RULES), &US_FEDERAL_YEARS },
+	{ "none", nullptr, 0, &WEEKEND_ONLY_YEARS },
+};
+
+const HolidayRuleSet* find_holiday_rule_set(const std::string& name) {
+	for (const HolidayRuleSet& set : HOLIDAY_RULE_SETS) {
+		if (name == set.name) {
+			return &set;
+		}
+	}
+	return nullptr;
+}
+
+// Business days (weekdays that are not holidays) as a bitmap: one bit per day of the year,
+// six 64-bit words per year. Counting business days between two dates is popcounts over
+// those words plus a per-year running total, never a walk over days or holidays. Holidays
+// come from a rule set plus any extra dates. Years FIRST_YEAR..LAST_YEAR are cached when the
+// calendar is built (copied from the compile-time table where it applies); the calendar is
+// immutable after that, so worker threads can share one.
+class BusinessCalendar {
+public:
+	static const int FIRST_YEAR = 1970;
+	static const int LAST_YEAR = 2100;
+	using YearBits = CalendarYearBits;
+
+	explicit BusinessCalendar(const HolidayRuleSet& rule_set = HOLIDAY_RULE_SETS[1], std::map<Date, std::string> extra_holidays = {})
+		: rule_set_(rule_set), extra_holidays_(std::move(extra_holidays)) {
+		ScopedPhase phase(Phase::Compute);
+		years_.reserve(LAST_YEAR - FIRST_YEAR + 1);
+		cum_year_days_.reserve(LAST_YEAR - FIRST_YEAR + 2);
+		cum_year_days_.push_back(0);
+		for (int year = FIRST_YEAR; year <= LAST_YEAR; ++year) {
+			years_.push_back(build_year(year));
+			cum_year_days_.push_back(cum_year_days_.back() + count_in_year(years_.back(), 0, days_in_year(year) - 1));
+		}
+	}
+
+	const HolidayRuleSet& rule_set() const { return rule_set_; }
+
+	// Name of the holiday observed on a date, or an empty string
+	std::string holiday_name(Date day) const {
+		auto found = extra_holidays_.find(day);
+		if (found != extra_holidays_.end()) {
+			return found->second;
+		}
+		for (size_t r = 0; r < rule_set_.rule_count; ++r) {
+			const HolidayRule& rule = rule_set_.rules[r];
+			for (int y = day.year(); y <= day.year() + 1; ++y) {
+				if (y >= rule.first_year && holiday_day_off(rule, y) == day) {
+					return rule.name;
+				}
+			}
+		}
+		return std::string();
+	}
+
+	bool is_business_day(Date day) const {
+		int year = day.year();
+		int doy = day - Date::from_ymd(year, 1, 1);
+		YearBits bits = bits_for(year);
+		return (bits[doy >> 6] >> (doy & 63)) & 1;
+	}
+
+	// A year's business-day bits: bit d of the words is day d of the year (0 = January 1)
+	YearBits year_bits(int year) const {
+		return bits_for(year);
+	}
+
+	// Number of business days in [first, last], 0 when the range is empty
+	int count_business_days(Date first, Date last) const {
+		if (last < first) {
+			return 0;
+		}
+		CivilYmd a = first.ymd();
+		CivilYmd b = last.ymd();
+		int first_doy = first - Date::from_ymd(a.year, 1, 1);
+		int last_doy = last - Date::from_ymd(b.year, 1, 1);
+		if (a.year == b.year) {
+			return count_in_year(bits_for(a.year), first_doy, last_doy);
+		}
+		return count_in_year(bits_for(a.year), first_doy, days_in_year(a.year) - 1) +
+			count_full_years(a.year + 1, b.year - 1) +
+			count_in_year(bits_for(b.year), 0, last_doy);
+	}
+
+	// The business day d with count_business_days(from, d) == n, for n >= 1
+	Date nth_business_day(Date from, int n) const {
+		int width = n;
+		while (count_business_days(from, from + (width - 1)) < n) {
+			width *= 2;
+		}
+		Date lo = from + (n - 1);
+		Date hi = from + (width - 1);
+		while (lo < hi) {
+			Date mid = lo + (hi - lo) / 2;
+			if (count_business_days(from, mid) < n) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+		return lo;
+	}
+
+private:
+	static int days_in_year(int year) {
+		return is_leap_year(year) ? 366 : 365;
+	}
+
+	YearBits build_year(int year) const {
+		Date jan1 = Date::from_ymd(year, 1, 1);
+		auto extra = extra_holidays_.lower_bound(jan1);
+		bool has_extra = extra != extra_holidays_.end() && extra->first.year() == year;
+		if (!has_extra && year >= PRECOMPUTED_FIRST_YEAR && year <= PRECOMPUTED_LAST_YEAR) {
+			return (*rule_set_.precomputed)[year - PRECOMPUTED_FIRST_YEAR];
+		}
+		YearBits bits = build_year_bits(year, rule_set_.rules, rule_set_.rule_count);
+		for (; extra != extra_holidays_.end() && extra->first.year() == year; ++extra) {
+			clear_day_bit(bits, extra->first - jan1);
+		}
+		return bits;
+	}
+
+	YearBits bits_for(int year) const {
+		if (year >= FIRST_YEAR && year <= LAST_YEAR) {
+			return years_[year - FIRST_YEAR];
+		}
+		return build_year(year);
+	}
+
+	// Set bits for days [lo, hi] of a year
+	static int count_in_year(const YearBits& bits, int lo, int hi) {
+		int count = 0;
+		for (int w = lo >> 6; w <= hi >> 6; ++w) {
+			uint64_t word = bits[w];
+			if (w == lo >> 6) {
+				word &= ~uint64_t(0) << (lo & 63);
+			}
+			if (w == hi >> 6 && (hi & 63) != 63) {
+				word &= (uint64_t(1) << ((hi & 63) + 1)) - 1;
+			}
+			count += popcount64(word);
+		}
+		return count;
+	}
+
+	int count_full_years(int from_year, int to_year) const {
+		int count = 0;
+		for (int year = from_year; year <= to_year; ++year) {
+			if (year >= FIRST_YEAR && year <= LAST_YEAR) {
+				int stop = std::min(to_year, LAST_YEAR);
+				count += cum_year_days_[stop - FIRST_YEAR + 1] - cum_year_days_[year - FIRST_YEAR];
+				year = stop;
+			}
+			else {
+				YearBits bits = build_year(year);
+				count += count_in_year(bits, 0, days_in_year(year) - 1);
+			}
+		}
+		return count;
+	}
+
+	const HolidayRuleSet& rule_set_;
+	std::map<Date, std::string> extra_holidays_;
+	std::vector<YearBits> years_;
+	std::vector<int> cum_year_days_;
+};
+
+int working_days_elapsed_since(Date start_date, const BusinessCalendar& calendar, Date as_of = today()) {
+	return calendar.count_business_days(start_date, as_of);
+}
+
+double calculate_accrued_hours(Date start_date, double accrual_rate, const BusinessCalendar& calendar, Date as_of = today()) {
+	return working_days_elapsed_since(start_date, calendar, as_of) * accrual_rate;
+}
+
+enum class LeaveKind : uint8_t { SingleDay, Range };
+
+// The days-off ledger decoded into parallel columns; JSON only appears in from_json/to_json.
+// Entry i covers [first[i], last[i]] and charges hours[i] (for a range: per weekday).
+// Reasons are interned, so entries only carry a small id.
+struct LeaveStore {
+	std::vector<Date> first;
+	std::vector<Date> last;
+	std::vector<double> hours;
+	std::vector<LeaveKind> kind;
+	std::vector<uint32_t> reason_id;
+	std::vector<std::string> reasons;
+	std::unordered_map<std::string, uint32_t> reason_ids;
+
+	LeaveStore() {
+		intern_reason("");
+	}
+
+	size_t size() const { return first.size(); }
+	bool empty() const { return first.empty(); }
+
+	const std::string& reason(size_t i) const { return reasons[reason_id[i]]; }
+
+	uint32_t intern_reason(const std::string& text) {
+		auto found = reason_ids.find(text);
+		if (found != reason_ids.end()) {
+			return found->second;
+		}
+		uint32_t id = static_cast<uint32_t>(reasons.size());
+		reasons.push_back(text);
+		reason_ids.emplace(text, id);
+		return id;
+	}
+
+	void reserve(size_t n) {
+		first.reserve(n);
+		last.reserve(n);
+		hours.reserve(n);
+		kind.reserve(n);
+		reason_id.reserve(n);
+	}
+
+	void add(Date from, Date to, double entry_hours, LeaveKind entry_kind, const std::string& text) {
+		first.push_back(from);
+		last.push_back(to);
+		hours.push_back(entry_hours);
+		kind.push_back(entry_kind);
+		reason_id.push_back(intern_reason(text));
+	}
+
+	// Drops single days on, and ranges starting on, the given day; returns how many went
+	size_t remove_starting_on(Date day) {
+		size_t kept = 0;
+		for (size_t i = 0; i < size(); ++i) {
+			if (first[i] == day) {
+				continue;
+			}
+			first[kept] = first[i];
+			last[kept] = last[i];
+			hours[kept] = hours[i];
+			kind[kept] = kind[i];
+			reason_id[kept] = reason_id[i];
+			kept++;
+		}
+		size_t removed = size() - kept;
+		first.resize(kept);
+		last.resize(kept);
+		hours.resize(kept);
+		kind.resize(kept);
+		reason_id.resize(kept);
+		return removed;
+	}
+
+	// Hours charged by entry i in total: ranges only charge business days
+	double total_hours(size_t i, const BusinessCalendar& calendar) const {
+		return kind[i] == LeaveKind::SingleDay ? hours[i] : calendar.count_business_days(first[i], last[i]) * hours[i];
+	}
+
+	// Appends one JSON entry; returns false for entries without a date or a start_date/end_date pair
+	bool add_json(const json& entry) {
+		std::string text = entry.value("reason", "");
+		if (entry.contains("date")) {
+			Date day = Date::parse(entry["date"]);
+			add(day, day, entry.value("hours", 8.0), LeaveKind::SingleDay, text);
+			return true;
+		}
+		if (entry.contains("start_date") && entry.contains("end_date")) {
+			add(Date::parse(entry["start_date"]), Date::parse(entry["end_date"]),
+				entry.value("hours_per_day", 8.0), LeaveKind::Range, text);
+			return true;
+		}
+		return false;
+	}
+
+	json entry_json(size_t i) const {
+		if (kind[i] == LeaveKind::SingleDay) {
+			return { {"date", first[i].to_string()}, {"hours", hours[i]}, {"reason", reason(i)} };
+		}
+		return {
+			{"start_date", first[i].to_string()},
+			{"end_date", last[i].to_string()},
+			{"hours_per_day", hours[i]},
+			{"reason", reason(i)}
+		};
+	}
+
+	// Entries without a date or a start_date/end_date pair are skipped
+	static LeaveStore from_json(const json& days_off) {
+		ScopedPhase phase(Phase::Parse);
+		LeaveStore store;
+		store.reserve(days_off.size());
+		for (const auto& entry : days_off) {
+			store.add_json(entry);
+		}
+		return store;
+	}
+
+	json to_json() const {
+		json days_off = json::array();
+		for (size_t i = 0; i < size(); ++i) {
+			days_off.push_back(entry_json(i));
+		}
+		return days_off;
+	}
+};
+
+// One days-off entry as a closed span of days. Single-day entries charge their hours
+// as-is; ranges charge hours_per_day for each business day they cover.
+struct LeaveSpan {
+	Date first;
+	Date last;
+	double hours_per_day = 8.0;
+	bool single_day = true;
+	size_t entry = 0; // position in the LeaveStore
+
+	double hours_between(Date from, Date to, const BusinessCalendar& calendar) const {
+		Date lo = first < from ? from : first;
+		Date hi = last > to ? to : last;
+		if (hi < lo) {
+			return 0.0;
+		}
+		return single_day ? hours_per_day : calendar.count_business_days(lo, hi) * hours_per_day;
+	}
+
+	double hours(const BusinessCalendar& calendar) const {
+		return hours_between(first, last, calendar);
+	}
+};
+
+LeaveSpan leave_span(const LeaveStore& store, size_t i) {
+	LeaveSpan span;
+	span.first = store.first[i];
+	span.last = store.last[i];
+	span.hours_per_day = store.hours[i];
+	span.single_day = store.kind[i] == LeaveKind::SingleDay;
+	span.entry = i;
+	return span;
+}
+
+struct LeaveDiff;
+
+// Days-off entries sorted by start with a running max of end dates and running hour totals.
+// Point lookups, overlap queries and hours-in-window are binary searches; when no entries
+// overlap (the normal case) the ends are sorted too and queries never scan.
+class DaysOffIndex {
+public:
+	DaysOffIndex(const LeaveStore& store, const BusinessCalendar& calendar) : calendar_(calendar) {
+		ScopedPhase phase(Phase::Compute);
+		spans_.reserve(store.size());
+		for (size_t i = 0; i < store.size(); ++i) {
+			spans_.push_back(leave_span(store, i));
+		}
+		std::sort(spans_.begin(), spans_.end(), span_before);
+		span_hours_.reserve(spans_.size());
+		for (const LeaveSpan& span : spans_) {
+			span_hours_.push_back(span.hours(calendar_));
+		}
+		cum_hours_.push_back(0.0);
+		rebuild_from(0);
+	}
+
+	// Brings the index in line with a new version of the store, given how it differs from the
+	// one indexed. Only spans that changed are located, inserted or charged against the
+	// calendar; the running maxima and totals are redone from the first changed position.
+	void apply(const LeaveDiff& diff);
+
+	size_t size() const { return spans_.size(); }
+	const LeaveSpan& operator[](size_t i) const { return spans_[i]; }
+	// The last day any entry covers (not always the last entry's: an earlier range can end
+	// later); the index must not be empty
+	Date last_covered() const { return max_last_.back(); }
+	const BusinessCalendar& calendar() const { return calendar_; }
+
+	// True if any entry covers the day
+	bool contains(Date day) const {
+		size_t i = count_starting_by(day);
+		return i > 0 && max_last_[i - 1] >= day;
+	}
+
+	// Positions (into this index) of entries overlapping [first, last], in start order
+	std::vector<size_t> overlapping(Date first, Date last) const {
+		std::vector<size_t> found;
+		if (last < first) {
+			return found;
+		}
+		size_t end = count_starting_by(last);
+		if (disjoint_) {
+			for (size_t i = first_ending_from(first, end); i < end; ++i) {
+				found.push_back(i);
+			}
+			return found;
+		}
+		// Overlapping legacy entries: walk back until no earlier entry can reach `first`
+		for (size_t i = end; i > 0 && max_last_[i - 1] >= first; --i) {
+			if (spans_[i - 1].last >= first) {
+				found.push_back(i - 1);
+			}
+		}
+		std::reverse(found.begin(), found.end());
+		return found;
+	}
+
+	// Hours charged for days falling inside [first, last]
+	double hours_used(Date first, Date last) const {
+		if (last < first) {
+			return 0.0;
+		}
+		if (!disjoint_) {
+			double used = 0.0;
+			for (size_t i : overlapping(first, last)) {
+				used += spans_[i].hours_between(first, last, calendar_);
+			}
+			return used;
+		}
+		size_t end = count_starting_by(last);
+		size_t begin = first_ending_from(first, end);
+		if (begin >= end) {
+			return 0.0;
+		}
+		// Everything in [begin, end) overlaps; only the two boundary entries can be clipped
+		double used = cum_hours_[end] - cum_hours_[begin];
+		used -= spans_[begin].hours(calendar_) - spans_[begin].hours_between(first, last, calendar_);
+		if (end - 1 != begin) {
+			used -= spans_[end - 1].hours(calendar_) - spans_[end - 1].hours_between(first, last, calendar_);
+		}
+		return used;
+	}
+
+	// Hours charged for days on or before last
+	double hours_used_through(Date last) const {
+		return spans_.empty() ? 0.0 : hours_used(spans_.front().first, last);
+	}
+
+	double total_hours() const {
+		return cum_hours_.back();
+	}
+
+private:
+	static bool span_before(const LeaveSpan& a, const LeaveSpan& b) {
+		return a.first != b.first ? a.first < b.first : a.last < b.last;
+	}
+
+	// Recomputes max_last_, cum_hours_ and disjoint_ for positions from `from` on
+	void rebuild_from(size_t from) {
+		max_last_.resize(from);
+		cum_hours_.resize(from + 1);
+		if (first_overlap_ >= from) {
+			first_overlap_ = SIZE_MAX;
+		}
+		for (size_t i = from; i < spans_.size(); ++i) {
+			if (i > 0 && first_overlap_ == SIZE_MAX && spans_[i].first <= max_last_.back()) {
+				first_overlap_ = i;
+			}
+			max_last_.push_back(i == 0 || spans_[i].last > max_last_.back() ? spans_[i].last : max_last_.back());
+			cum_hours_.push_back(cum_hours_.back() + span_hours_[i]);
+		}
+		disjoint_ = first_overlap_ == SIZE_MAX;
+	}
+
+	// Number of entries starting on or before day
+	size_t count_starting_by(Date day) const {
+		return static_cast<size_t>(std::upper_bound(spans_.begin(), spans_.end(), day,
+			[](Date d, const LeaveSpan& span) { return d < span.first; }) - spans_.begin());
+	}
+
+	// First entry before `end` ending on or after day (only valid when entries are disjoint)
+	size_t first_ending_from(Date day, size_t end) const {
+		return static_cast<size_t>(std::lower_bound(spans_.begin(), spans_.begin() + end, day,
+			[](const LeaveSpan& span, Date d) { return span.last < d; }) - spans_.begin());
+	}
+
+	const BusinessCalendar& calendar_;
+	std::vector<LeaveSpan> spans_;
+	std::vector<double> span_hours_;
+	std::vector<Date> max_last_;
+	std::vector<double> cum_hours_;
+	size_t first_overlap_ = SIZE_MAX; // first span starting before an earlier one ends
+	bool disjoint_ = true;
+};
+
+// How a newer version of a ledger's entries differs from an older one
+struct LeaveDiff {
+	std::vector<LeaveSpan> removed;  // entries only in the old version (entry = old position)
+	std::vector<LeaveSpan> added;    // entries only in the new version (entry = new position)
+	std::vector<size_t> moved_to;    // new position of each old entry, SIZE_MAX if removed
+
+	bool empty() const { return removed.empty() && added.empty(); }
+};
+
+// Matches entries of the two versions by value (dates, hours, kind and reason), so entries
+// that only moved within the file count as unchanged
+LeaveDiff diff_leave(const LeaveStore& before, const LeaveStore& after) {
+	auto sorted_entries = [](const LeaveStore& store) {
+		std::vector<size_t> order(store.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return std::tie(store.first[a], store.last[a], store.hours[a], store.kind[a]) <
+				std::tie(store.first[b], store.last[b], store.hours[b], store.kind[b]);
+		});
+		return order;
+	};
+	auto compare = [&](size_t a, size_t b) {
+		if (std::tie(before.first[a], before.last[a], before.hours[a], before.kind[a]) !=
+			std::tie(after.first[b], after.last[b], after.hours[b], after.kind[b])) {
+			return std::tie(before.first[a], before.last[a], before.hours[a], before.kind[a]) <
+				std::tie(after.first[b], after.last[b], after.hours[b], after.kind[b]) ? -1 : 1;
+		}
+		return before.reason(a).compare(after.reason(b));
+	};
+
+	LeaveDiff diff;
+	diff.moved_to.assign(before.size(), SIZE_MAX);
+	std::vector<size_t> old_order = sorted_entries(before);
+	std::vector<size_t> new_order = sorted_entries(after);
+	size_t i = 0;
+	size_t j = 0;
+	while (i < old_order.size() || j < new_order.size()) {
+		int order = i == old_order.size() ? 1 : j == new_order.size() ? -1 : compare(old_order[i], new_order[j]);
+		if (order == 0) {
+			diff.moved_to[old_order[i++]] = new_order[j++];
+		}
+		else if (order < 0) {
+			diff.removed.push_back(leave_span(before, old_order[i++]));
+		}
+		else {
+			diff.added.push_back(leave_span(after, new_order[j++]));
+		}
+	}
+	return diff;
+}
+
+// The diff of appending the store's last entry, for an index built before the append
+LeaveDiff diff_append(const LeaveStore& after) {
+	LeaveDiff diff;
+	diff.moved_to.resize(after.size() - 1);
+	for (size_t i = 0; i < diff.moved_to.size(); ++i) {
+		diff.moved_to[i] = i;
+	}
+	diff.added.push_back(leave_span(after, after.size() - 1));
+	return diff;
+}
+
+// The diff LeaveStore::remove_starting_on(day) is about to make, taken before the removal
+LeaveDiff diff_remove_starting_on(const LeaveStore& before, Date day) {
+	LeaveDiff diff;
+	diff.moved_to.assign(before.size(), SIZE_MAX);
+	size_t kept = 0;
+	for (size_t i = 0; i < before.size(); ++i) {
+		if (before.first[i] == day) {
+			diff.removed.push_back(leave_span(before, i));
+		}
+		else {
+			diff.moved_to[i] = kept++;
+		}
+	}
+	return diff;
+}
+
+void DaysOffIndex::apply(const LeaveDiff& diff) {
+	ScopedPhase phase(Phase::Compute);
+	size_t from = spans_.size();
+	for (const LeaveSpan& gone : diff.removed) {
+		size_t i = static_cast<size_t>(std::lower_bound(spans_.begin(), spans_.end(), gone, span_before) - spans_.begin());
+		while (i < spans_.size() && spans_[i].entry != gone.entry) {
+			++i;
+		}
+		if (i < spans_.size()) {
+			spans_.erase(spans_.begin() + i);
+			span_hours_.erase(span_hours_.begin() + i);
+			from = std::min(from, i);
+		}
+	}
+	for (LeaveSpan& span : spans_) {
+		span.entry = diff.moved_to[span.entry];
+	}
+	for (const LeaveSpan& span : diff.added) {
+		size_t i = static_cast<size_t>(std::upper_bound(spans_.begin(), spans_.end(), span, span_before) - spans_.begin());
+		spans_.insert(spans_.begin() + i, span);
+		span_hours_.insert(span_hours_.begin() + i, span.hours(calendar_));
+		from = std::min(from, i);
+	}
+	rebuild_from(from);
+}
+
+// Whether the date is covered by any days off entry, single day or range
+bool is_day_off(const DaysOffIndex& index, Date date) {
+	return index.contains(date);
+}
+
+double calculate_hours_of_days_off(const DaysOffIndex& index) {
+	return index.total_hours();
+}
+
+// The same month and day some years later; Feb 29 becomes Feb 28 in common years
+Date add_years(Date date, int years) {
+	CivilYmd c = date.ymd();
+	int year = c.year + years;
+	return Date::from_ymd(year, c.month, std::min(c.day, days_in_month(year, c.month)));
+}
+
+struct AccrualTier {
+	int after_years = 0;
+	double rate_per_day = 0.0;
+};
+
+// How an employee earns PTO. Settings either give a flat "accrual_rate_per_day" or an
+// "accrual_policy" object:
+//   "tiers": [{"after_years": 0, "rate_per_day": 0.4}, {"after_years": 3, "rate_per_day": 0.5}]
+//   "cap_hours": 160            accrual stops while the balance is at the cap
+//   "grant_every_days": 14      credit the hours earned so far every 14 days instead of daily
+//   "grant_anchor": "2024-01-05"  a grant date (default: the start date)
+//   "carryover_hours": 40       at each anniversary, the balance above this expires
+// A rate earns that many hours per business day from the tier's anniversary of the start
+// date; before the first tier nothing accrues.
+struct AccrualPolicy {
+	Date hired;
+	std::vector<AccrualTier> tiers;
+	double cap_hours = std::numeric_limits<double>::infinity();
+	int grant_every_days = 0;
+	Date grant_anchor;
+	double carryover_hours = std::numeric_limits<double>::infinity();
+
+	bool capped() const { return std::isfinite(cap_hours); }
+	bool carries_over() const { return std::isfinite(carryover_hours); }
+	// Whether accrual depends on the leave taken, not just on the calendar
+	bool needs_usage() const { return capped() || carries_over(); }
+};
+
+AccrualPolicy accrual_policy_for(const json& settings) {
+	AccrualPolicy policy;
+	policy.hired = Date::parse(settings["start_date"]);
+	policy.grant_anchor = policy.hired;
+	if (!settings.contains("accrual_policy")) {
+		policy.tiers.push_back({ 0, settings["accrual_rate_per_day"].get<double>() });
+		return policy;
+	}
+	const json& config = settings["accrual_policy"];
+	if (!config.is_object()) {
+		throw std::runtime_error("accrual_policy must be an object.");
+	}
+	if (config.contains("tiers")) {
+		for (const json& tier : config["tiers"]) {
+			AccrualTier parsed;
+			parsed.after_years = tier.value("after_years", 0);
+			parsed.rate_per_day = tier.at("rate_per_day").get<double>();
+			if (parsed.after_years < 0 || parsed.rate_per_day < 0.0 ||
+				(!policy.tiers.empty() && parsed.after_years <= policy.tiers.back().after_years)) {
+				throw std::runtime_error("accrual_policy tiers need ascending after_years and non-negative rates.");
+			}
+			policy.tiers.push_back(parsed);
+		}
+	}
+	else {
+		policy.tiers.push_back({ 0, settings["accrual_rate_per_day"].get<double>() });
+	}
+	if (config.contains("cap_hours")) {
+		policy.cap_hours = config["cap_hours"].get<double>();
+		if (!(policy.cap_hours > 0.0)) {
+			throw std::runtime_error("accrual_policy cap_hours must be positive.");
+		}
+	}
+	if (config.contains("grant_every_days")) {
+		policy.grant_every_days = config["grant_every_days"].get<int>();
+		if (policy.grant_every_days < 1) {
+			throw std::runtime_error("accrual_policy grant_every_days must be at least 1.");
+		}
+		if (config.contains("grant_anchor")) {
+			policy.grant_anchor = Date::parse(config["grant_anchor"].get<std::string>());
+		}
+	}
+	if (config.contains("carryover_hours")) {
+		policy.carryover_hours = config["carryover_hours"].get<double>();
+		if (!(policy.carryover_hours >= 0.0)) {
+			throw std::runtime_error("accrual_policy carryover_hours must not be negative.");
+		}
+	}
+	return policy;
+}
+
+// Hours charged per day from a date on (by default, all of them), in date order, each day once
+std::vector<std::pair<Date, double>> daily_charges(const DaysOffIndex& index, Date from = Date(INT32_MIN)) {
+	std::vector<std::pair<Date, double>> charges;
+	for (size_t i = 0; i < index.size(); ++i) {
+		const LeaveSpan& span = index[i];
+		for (Date d = std::max(span.first, from); d <= span.last; ++d) {
+			if (span.single_day || index.calendar().is_business_day(d)) {
+				charges.emplace_back(d, span.hours_per_day);
+			}
+		}
+	}
+	std::sort(charges.begin(), charges.end());
+	size_t kept = 0;
+	for (size_t i = 0; i < charges.size(); ++i) {
+		if (kept > 0 && charges[kept - 1].first == charges[i].first) {
+			charges[kept - 1].second += charges[i].second;
+		}
+		else {
+			charges[kept++] = charges[i];
+		}
+	}
+	charges.resize(kept);
+	return charges;
+}
+
+// An accrual policy compiled for one employee into pieces: from piece.from on, the hours
+// credited through a credit moment t are base + rate * (business days in [from, t]). A
+// credit moment is every day, or with grants the last grant date on or before the day asked
+// about. Tier anniversaries start pieces. A cap or carryover makes the credited hours depend
+// on the leave taken, so such plans are compiled against the ledger by walking tier starts,
+// charge days and anniversaries in date order: each stretch between them is solved for the
+// day it reaches the cap (a rate-0 piece until the next charge), and at each anniversary the
+// balance above the carryover expires, which the walk treats as a charge. Compiling is
+// O(tiers + charged days + years) and a query is a binary search plus one business-day
+// count, however long the tenure.
+class AccrualPlan {
+public:
+	struct Piece {
+		Date from;
+		double base;
+		double rate;
+	};
+
+	// The walk's state on an anniversary, after the expiry, so a later compile can resume
+	// there instead of at the start date
+	struct Resume {
+		Date at;
+		std::vector<Piece> pieces; // from the one covering the last credit moment before `at`
+		double used = 0.0;         // hours charged before `at`, expired hours included
+		double expired = 0.0;
+		double rate = 0.0;
+		bool at_cap = false;
+		double closing_balance = 0.0;
+	};
+
+	// A plan that ignores leave: exact for policies without a cap or carryover
+	AccrualPlan(const AccrualPolicy& policy, const BusinessCalendar& calendar)
+		: policy_(policy), calendar_(&calendar) {
+		compile({}, nullptr);
+	}
+
+	AccrualPlan(const AccrualPolicy& policy, const DaysOffIndex& index)
+		: policy_(policy), calendar_(&index.calendar()) {
+		ScopedPhase phase(Phase::Compute);
+		compile(policy.needs_usage() ? daily_charges(index) : std::vector<std::pair<Date, double>>(), nullptr);
+	}
+
+	// Continues a walk from an anniversary; answers only for dates on or after it
+	AccrualPlan(const AccrualPolicy& policy, const DaysOffIndex& index, const Resume& resume)
+		: policy_(policy), calendar_(&index.calendar()) {
+		ScopedPhase phase(Phase::Compute);
+		compile(daily_charges(index, resume.at), &resume);
+	}
+
+	Date hired() const { return policy_.hired; }
+	size_t pieces() const { return pieces_.size(); }
+
+	// The walk's state at every anniversary it passed under a carryover policy
+	const std::vector<Resume>& anniversaries() const { return anniversaries_; }
+
+	// Hours credited on or before a date
+	double accrued_on(Date date) const {
+		return credited_at(credit_moment(date));
+	}
+
+	// Whether accrued hours are credited on a date (every day, or with grants each grant date)
+	bool credits_on(Date date) const {
+		return credit_moment(date) == date;
+	}
+
+	// Hours that expired at anniversaries on or before a date
+	double expired_through(Date date) const {
+		auto last = std::upper_bound(expirations_.begin(), expirations_.end(), date,
+			[](Date d, const std::pair<Date, double>& e) { return d < e.first; });
+		return last == expirations_.begin() ? expired_before_ : (last - 1)->second;
+	}
+
+	// The tier's hours per business day on a date (what accrues when not at the cap)
+	double rate_on(Date date) const {
+		double rate = 0.0;
+		for (const AccrualTier& tier : policy_.tiers) {
+			if (add_years(policy_.hired, tier.after_years) <= date) {
+				rate = tier.rate_per_day;
+			}
+		}
+		return rate;
+	}
+
+private:
+	// The last day on or before `date` that hours are credited
+	Date credit_moment(Date date) const {
+		if (policy_.grant_every_days == 0) {
+			return date;
+		}
+		int offset = date - policy_.grant_anchor;
+		int period = policy_.grant_every_days;
+		int periods = offset >= 0 ? offset / period : -((-offset + period - 1) / period);
+		return policy_.grant_anchor + periods * period;
+	}
+
+	Date next_credit_moment(Date date) const {
+		Date moment = credit_moment(date);
+		return moment == date ? date : moment + policy_.grant_every_days;
+	}
+
+	size_t piece_at(Date moment) const {
+		auto piece = std::upper_bound(pieces_.begin(), pieces_.end(), moment,
+			[](Date d, const Piece& p) { return d < p.from; });
+		return piece == pieces_.begin() ? 0 : static_cast<size_t>(piece - pieces_.begin()) - 1;
+	}
+
+	double credited_at(Date moment) const {
+		if (pieces_.empty() || moment < pieces_.front().from) {
+			return 0.0;
+		}
+		const Piece& piece = pieces_[piece_at(moment)];
+		return piece.rate == 0.0 ? piece.base : piece.base + piece.rate * calendar_->count_business_days(piece.from, moment);
+	}
+
+	void push(Piece piece) {
+		if (!pieces_.empty() && pieces_.back().from >= piece.from) {
+			pieces_.back() = piece;
+		}
+		else {
+			pieces_.push_back(piece);
+		}
+	}
+
+	// Leaves the cap: accrual resumes the day after `after`, at the rates of the first
+	// `tiers` tiers in effect since then
+	void resume_growth(Date after, double base, size_t tiers) {
+		Date resume = after + 1;
+		push({ resume, base, rate_on(resume) });
+		for (size_t k = 0; k < tiers; ++k) {
+			Date start = add_years(policy_.hired, policy_.tiers[k].after_years);
+			if (start > resume) {
+				const Piece& last = pieces_.back();
+				push({ start, last.base + last.rate * calendar_->count_business_days(last.from, start - 1), policy_.tiers[k].rate_per_day });
+			}
+		}
+	}
+
+	void compile(const std::vector<std::pair<Date, double>>& charges, const Resume* resume) {
+		const Date never(INT32_MAX);
+		double rate = 0.0;
+		size_t tier = 0;
+		double used = 0.0;
+		double expired = 0.0;
+		bool at_cap = false;
+		size_t charge = 0;
+		Date lo = policy_.hired;
+		int year = 1;
+		if (resume) {
+			for (; tier < policy_.tiers.size() && add_years(policy_.hired, policy_.tiers[tier].after_years) < resume->at; ++tier) {
+			}
+			while (add_years(policy_.hired, year) <= resume->at) {
+				year++;
+			}
+			rate = resume->rate;
+			used = resume->used;
+			expired = expired_before_ = resume->expired;
+			at_cap = resume->at_cap;
+			pieces_ = resume->pieces;
+			lo = resume->at;
+		}
+		else {
+			for (; tier < policy_.tiers.size() && policy_.tiers[tier].after_years == 0; ++tier) {
+				rate = policy_.tiers[tier].rate_per_day;
+			}
+			// Leave charged before the start date still counts against the balance
+			for (; charge < charges.size() && charges[charge].first < policy_.hired; ++charge) {
+				used += charges[charge].second;
+			}
+			pieces_.push_back({ policy_.hired, 0.0, rate });
+		}
+		for (;;) {
+			Date tier_at = tier < policy_.tiers.size() ? add_years(policy_.hired, policy_.tiers[tier].after_years) : never;
+			Date charge_at = charge < charges.size() ? charges[charge].first : never;
+			// Expiry happens at the end of the day before each anniversary, through the last year
+			// the calendar caches
+			Date expire_at = never;
+			if (policy_.carries_over() && add_years(policy_.hired, year).year() <= BusinessCalendar::LAST_YEAR) {
+				expire_at = add_years(policy_.hired, year) - 1;
+			}
+			Date hi = std::min(tier_at == never ? never : tier_at - 1, std::min(charge_at, expire_at));
+			// The balance only rises over [lo, hi]: find the first credit moment at the cap. A piece
+			// can start at or over it (a tier's base holds hours earned but not yet granted), even
+			// at a zero rate.
+			const Piece& growing = pieces_.back();
+			Date last_moment = hi == never ? never : credit_moment(hi);
+			if (policy_.capped() && !at_cap && (last_moment == never || (last_moment >= lo &&
+				growing.base + growing.rate * calendar_->count_business_days(growing.from, last_moment) >= policy_.cap_hours + used))) {
+				double short_by = policy_.cap_hours + used - growing.base;
+				double needed = short_by <= 0.0 ? 0.0 : growing.rate > 0.0 ? short_by / growing.rate : HUGE_VAL;
+				if (needed < 1e6) {
+					Date reach = needed <= 0.0 ? lo : calendar_->nth_business_day(growing.from, static_cast<int>(std::ceil(needed)));
+					Date moment = next_credit_moment(std::max(reach, lo));
+					if (moment <= hi) {
+						push({ moment, policy_.cap_hours + used, 0.0 });
+						at_cap = true;
+					}
+				}
+			}
+			if (hi == never) {
+				break;
+			}
+			if (hi == charge_at) {
+				double hours = 0.0;
+				for (; charge < charges.size() && charges[charge].first == charge_at; ++charge) {
+					hours += charges[charge].second;
+				}
+				if (at_cap) {
+					resume_growth(credit_moment(charge_at), policy_.cap_hours + used, tier);
+					at_cap = false;
+				}
+				used += hours;
+				lo = charge_at + 1;
+			}
+			else if (hi == expire_at) {
+				Date moment = credit_moment(expire_at);
+				double balance = credited_at(moment) - used;
+				double excess = std::max(0.0, balance - policy_.carryover_hours);
+				if (excess > 0.0) {
+					if (at_cap) {
+						resume_growth(moment, policy_.cap_hours + used, tier);
+						at_cap = false;
+					}
+					used += excess;
+					expired += excess;
+					expirations_.emplace_back(expire_at + 1, expired);
+				}
+				Resume state;
+				state.at = expire_at + 1;
+				state.pieces.assign(pieces_.begin() + static_cast<std::ptrdiff_t>(piece_at(moment)), pieces_.end());
+				state.used = used;
+				state.expired = expired;
+				state.rate = rate;
+				state.at_cap = at_cap;
+				state.closing_balance = balance - excess;
+				anniversaries_.push_back(std::move(state));
+				lo = expire_at + 1;
+				year++;
+			}
+			else {
+				rate = policy_.tiers[tier++].rate_per_day;
+				if (!at_cap) {
+					const Piece& last = pieces_.back();
+					push({ tier_at, last.base + last.rate * calendar_->count_business_days(last.from, tier_at - 1), rate });
+				}
+				lo = tier_at;
+			}
+		}
+	}
+
+	AccrualPolicy policy_;
+	const BusinessCalendar* calendar_;
+	std::vector<Piece> pieces_;
+	std::vector<std::pair<Date, double>> expirations_; // anniversary, hours expired through it
+	double expired_before_ = 0.0;
+	std::vector<Resume> anniversaries_;
+};
+
+// Running PTO balance for every day from the hire date through a horizon: accrual on each
+// business day minus the hours charged that day and any hours expired that day. Built once per ledger so a balance query is an
+// array lookup; dates outside the built window fall back to the index in O(log n).
+class BalanceTimeline {
+public:
+	BalanceTimeline(const AccrualPlan& plan, Date horizon, const DaysOffIndex& index)
+		: hired_(plan.hired()), horizon_(horizon < hired_ ? hired_ : horizon), plan_(&plan), index_(index) {
+		ScopedPhase phase(Phase::Compute);
+		std::vector<double> used(static_cast<size_t>(horizon_ - hired_) + 1, 0.0);
+		for (size_t i = 0; i < index.size(); ++i) {
+			const LeaveSpan& span = index[i];
+			Date lo = span.first < hired_ ? hired_ : span.first;
+			Date hi = span.last > horizon_ ? horizon_ : span.last;
+			for (Date d = lo; d <= hi; ++d) {
+				if (span.single_day || index.calendar().is_business_day(d)) {
+					used[static_cast<size_t>(d - hired_)] += span.hours_per_day;
+				}
+			}
+		}
+
+		// Usage charged before the hire date still counts against the balance
+		double used_so_far = index.hours_used_through(hired_ - 1);
+		balance_.resize(used.size());
+		for (size_t i = 0; i < used.size(); ++i) {
+			used_so_far += used[i];
+			Date day = hired_ + static_cast<int>(i);
+			balance_[i] = accrued_on(day) - used_so_far - plan_->expired_through(day);
+		}
+	}
+
+	// Patches an edit of the leave (already applied to the index) into the balances: days
+	// from the first one the edit charges or refunds shift by the hours it changed through
+	// them. `plan` is the plan from now on; when it is not the one the timeline was reading
+	// (a cap or carryover replans on edits), the difference in accrual and expiry between the
+	// two from that day on is folded in as well, so the old plan must still be alive.
+	void apply(const LeaveDiff& diff, const AccrualPlan& plan) {
+		ScopedPhase phase(Phase::Compute);
+		Date from = horizon_ + 1;
+		for (const std::vector<LeaveSpan>* spans : { &diff.removed, &diff.added }) {
+			for (const LeaveSpan& span : *spans) {
+				from = std::min(from, std::max(span.first, hired_));
+			}
+		}
+		if (from <= horizon_) {
+			// Hours charged on each day from `from` on, with anything before the hire date on the first day
+			std::vector<double> charged(static_cast<size_t>(horizon_ - from) + 1, 0.0);
+			auto charge = [&](const LeaveSpan& span, double sign) {
+				for (Date d = span.first; d <= span.last && d <= horizon_; ++d) {
+					if (span.single_day || index_.calendar().is_business_day(d)) {
+						charged[static_cast<size_t>(std::max(d, from) - from)] += sign * span.hours_per_day;
+					}
+				}
+			};
+			for (const LeaveSpan& span : diff.removed) {
+				charge(span, -1.0);
+			}
+			for (const LeaveSpan& span : diff.added) {
+				charge(span, 1.0);
+			}
+			double used = 0.0;
+			for (size_t i = 0; i < charged.size(); ++i) {
+				Date day = from + static_cast<int>(i);
+				used += charged[i];
+				double& balance = balance_[static_cast<size_t>(day - hired_)];
+				balance -= used;
+				if (&plan != plan_) {
+					balance += plan.accrued_on(day) - plan_->accrued_on(day) - (plan.expired_through(day) - plan_->expired_through(day));
+				}
+			}
+		}
+		plan_ = &plan;
+	}
+
+	Date first() const { return hired_; }
+	Date last() const { return horizon_; }
+
+	double accrued_on(Date date) const {
+		return plan_->accrued_on(date);
+	}
+
+	double used_through(Date date) const {
+		return accrued_on(date) - plan_->expired_through(date) - balance_on(date);
+	}
+
+	double balance_on(Date date) const {
+		if (date >= hired_ && date <= horizon_) {
+			return balance_[static_cast<size_t>(date - hired_)];
+		}
+		return accrued_on(date) - index_.hours_used_through(date) - plan_->expired_through(date);
+	}
+
+private:
+	Date hired_;
+	Date horizon_;
+	const AccrualPlan* plan_;
+	const DaysOffIndex& index_;
+	std::vector<double> balance_;
+};
+
+// How far a ledger's timeline is built: through the given date, today and the last leave booked
+Date balance_horizon(const DaysOffIndex& index, Date through) {
+	Date horizon = std::max(through, today());
+	if (index.size() > 0) {
+		horizon = std::max(horizon, index.last_covered());
+	}
+	return horizon;
+}
+
+// CRC-32 (IEEE 802.3), used to checksum journal records and snapshots
+uint32_t crc32(const char* data, size_t size, uint32_t crc = 0) {
+	static const auto table = [] {
+		std::array<uint32_t, 256> t{};
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+uint32_t crc32(const std::string& data) {
+	return crc32(data.data(), data.size());
+}
+
+std::string read_file(const std::string& path) {
+	ScopedPhase phase(Phase::Load);
+	std::ifstream ifs(path, std::ios::binary);
+	std::ostringstream contents;
+	contents << ifs.rdbuf();
+	return contents.str();
+}
+
+// On-disk encodings for settings and ledgers, picked by file extension. Binary snapshots go
+// through json.hpp's CBOR and MessagePack codecs and take about half the space of the text.
+enum class DocumentFormat { Json, Cbor, MsgPack };
+
+const DocumentFormat ALL_DOCUMENT_FORMATS[] = { DocumentFormat::Json, DocumentFormat::Cbor, DocumentFormat::MsgPack };
+
+const char* format_name(DocumentFormat format) {
+	switch (format) {
+	case DocumentFormat::Cbor: return "cbor";
+	case DocumentFormat::MsgPack: return "msgpack";
+	default: return "json";
+	}
+}
+
+bool parse_format_name(const std::string& name, DocumentFormat& format) {
+	for (DocumentFormat candidate : ALL_DOCUMENT_FORMATS) {
+		if (name == format_name(candidate)) {
+			format = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+DocumentFormat format_for_path(const std::string& path) {
+	DocumentFormat format = DocumentFormat::Json;
+	std::string ext = fs::path(path).extension().string();
+	if (!ext.empty()) {
+		parse_format_name(ext.substr(1), format);
+	}
+	return format;
+}
+
+std::string with_format_extension(const std::string& path, DocumentFormat format) {
+	return fs::path(path).replace_extension(format_name(format)).string();
+}
+
+json decode_document(const std::string& bytes, DocumentFormat format) {
+	ScopedPhase phase(Phase::Parse);
+	switch (format) {
+	case DocumentFormat::Cbor: return json::from_cbor(bytes);
+	case DocumentFormat::MsgPack: return json::from_msgpack(bytes);
+	default: return json::parse(bytes);
+	}
+}
+
+// Builds a LeaveStore straight from the SAX events of a days_off document (JSON, CBOR or
+// MessagePack) with no json tree in between. Entries are read the way LeaveStore::add_json
+// reads them; other keys are skipped without being stored, and so are reasons when the
+// caller does not need them.
+class LeaveStoreSax {
+public:
+	using number_integer_t = json::number_integer_t;
+	using number_unsigned_t = json::number_unsigned_t;
+	using number_float_t = json::number_float_t;
+	using string_t = json::string_t;
+	using binary_t = json::binary_t;
+
+	LeaveStoreSax(LeaveStore& store, bool with_reasons) : store_(store), with_reasons_(with_reasons) {}
+
+	bool null() { return value(); }
+	bool boolean(bool) { return value(); }
+	bool number_integer(number_integer_t n) { return number(static_cast<double>(n)); }
+	bool number_unsigned(number_unsigned_t n) { return number(static_cast<double>(n)); }
+	bool number_float(number_float_t n, const string_t&) { return number(n); }
+	bool binary(binary_t&) { return value(); }
+
+	bool string(string_t& text) {
+		if (depth_ == 2) {
+			switch (field_) {
+			case Field::Date: date_.swap(text); has_date_ = true; return true;
+			case Field::StartDate: start_date_.swap(text); has_start_date_ = true; return true;
+			case Field::EndDate: end_date_.swap(text); has_end_date_ = true; return true;
+			case Field::Reason:
+				if (with_reasons_) {
+					reason_.swap(text);
+				}
+				return true;
+			default: break;
+			}
+		}
+		return value();
+	}
+
+	bool start_object(std::size_t) {
+		if (depth_ == 1) {
+			has_date_ = has_start_date_ = has_end_date_ = false;
+			hours_ = hours_per_day_ = 8.0;
+			reason_.clear();
+		}
+		else {
+			value();
+		}
+		depth_++;
+		return true;
+	}
+
+	bool key(string_t& name) {
+		if (depth_ == 2) {
+			field_ = name == "date" ? Field::Date
+				: name == "start_date" ? Field::StartDate
+				: name == "end_date" ? Field::EndDate
+				: name == "hours" ? Field::Hours
+				: name == "hours_per_day" ? Field::HoursPerDay
+				: name == "reason" ? Field::Reason
+				: Field::Other;
+		}
+		return true;
+	}
+
+	bool end_object() {
+		if (--depth_ == 1) {
+			if (has_date_) {
+				Date day = Date::parse(date_);
+				store_.add(day, day, hours_, LeaveKind::SingleDay, reason_);
+			}
+			else if (has_start_date_ && has_end_date_) {
+				store_.add(Date::parse(start_date_), Date::parse(end_date_), hours_per_day_, LeaveKind::Range, reason_);
+			}
+		}
+		return true;
+	}
+
+	bool start_array(std::size_t size) {
+		if (depth_ == 0) {
+			if (size != static_cast<std::size_t>(-1)) {
+				store_.reserve(size);
+			}
+			depth_++;
+			return true;
+		}
+		value();
+		depth_++;
+		return true;
+	}
+
+	bool end_array() {
+		depth_--;
+		return true;
+	}
+
+	bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& error) {
+		throw std::runtime_error(error.what());
+	}
+
+private:
+	enum class Field { Other, Date, StartDate, EndDate, Hours, HoursPerDay, Reason };
+
+	bool number(double n) {
+		if (depth_ == 2 && field_ == Field::Hours) {
+			hours_ = n;
+			return true;
+		}
+		if (depth_ == 2 && field_ == Field::HoursPerDay) {
+			hours_per_day_ = n;
+			return true;
+		}
+		return value();
+	}
+
+	// Any value the handlers above did not take: fine under a key that is ignored, an error
+	// where a days_off entry, or a value of the type add_json expects, should be
+	bool value() {
+		if (depth_ == 0) {
+			throw std::runtime_error("days_off must be an array of entries.");
+		}
+		if (depth_ == 1) {
+			throw std::runtime_error("Each days_off entry must be an object.");
+		}
+		if (depth_ == 2 && field_ != Field::Other) {
+			throw std::runtime_error("Invalid value for a days_off entry field.");
+		}
+		return true;
+	}
+
+	LeaveStore& store_;
+	bool with_reasons_;
+	int depth_ = 0;
+	Field field_ = Field::Other;
+	bool has_date_ = false;
+	bool has_start_date_ = false;
+	bool has_end_date_ = false;
+	double hours_ = 8.0;
+	double hours_per_day_ = 8.0;
+	std::string date_;
+	std::string start_date_;
+	std::string end_date_;
+	std::string reason_;
+};
+
+// Decodes a days_off document into a LeaveStore without building a json tree
+LeaveStore decode_leave_store(const std::string& bytes, DocumentFormat format, bool with_reasons = true) {
+	ScopedPhase phase(Phase::Parse);
+	LeaveStore store;
+	LeaveStoreSax sax(store, with_reasons);
+	json::input_format_t input = format == DocumentFormat::Cbor ? json::input_format_t::cbor
+		: format == DocumentFormat::MsgPack ? json::input_format_t::msgpack : json::input_format_t::json;
+	json::sax_parse(bytes.begin(), bytes.end(), &sax, input);
+	return store;
+}
+
+std::string encode_document(const json& document, DocumentFormat format) {
+	std::string bytes;
+	switch (format) {
+	case DocumentFormat::Cbor: json::to_cbor(document, bytes); break;
+	case DocumentFormat::MsgPack: json::to_msgpack(document, bytes); break;
+	default: bytes = document.dump(4); break; // pretty print
+	}
+	return bytes;
+}
+
+// The path itself if it exists, otherwise a sibling in another format (settings.cbor for
+// settings.json), otherwise the path unchanged
+std::string find_document(const std::string& path) {
+	if (fs::exists(path)) {
+		return path;
+	}
+	for (DocumentFormat format : ALL_DOCUMENT_FORMATS) {
+		std::string candidate = with_format_extension(path, format);
+		if (fs::exists(candidate)) {
+			return candidate;
+		}
+	}
+	return path;
+}
+
+// Reads and decodes a settings or ledger file in whatever format its extension names
+json load_document(const std::string& path) {
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs) {
+		throw std::runtime_error("Cannot open " + path + ".");
+	}
+	return decode_document(read_file(path), format_for_path(path));
+}
+
+// Writes to a temporary file and renames it into place, so a crash mid-write leaves the
+// previous file intact
+bool write_file_atomic(const std::string& path, const std::string& bytes) {
+	ScopedPhase phase(Phase::Save);
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+		if (!ofs || !ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size())).flush()) {
+			std::cerr << "Error: Unable to write to " << tmp_path << "\n";
+			return false;
+		}
+	}
+	std::error_code ec;
+	fs::rename(tmp_path, path, ec);
+	if (ec) {
+		std::cerr << "Error: Unable to replace " << path << ": " << ec.message() << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool save_document(const std::string& path, const json& document) {
+	ScopedPhase phase(Phase::Save);
+	return write_file_atomic(path, encode_document(document, format_for_path(path)));
+}
+
+// Read-optimized ledger image (.ptol): a header, fixed-width records sorted by start, then a
+// heap of reason strings. Records carry the running max of end dates, so a mapped file
+// answers is-day-off with a binary search in place and the summary sums hours straight off
+// the records, with no parse step. Fields are stored in host (little-endian) byte order.
+const char LEDGER_IMAGE_MAGIC[4] = { 'P', 'T', 'O', 'L' };
+// Version 1 headers carried a total of hours where `reserved` now is; the total was charged
+// under the calendar of the day the image was written, so those images are not read
+const uint32_t LEDGER_IMAGE_VERSION = 2;
+const char* const LEDGER_IMAGE_EXTENSION = ".ptol";
+
+struct LedgerImageHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+	uint32_t content_crc; // crc32 of the records and heap, identifies the snapshot to the journal
+	uint64_t heap_offset;
+	uint64_t heap_size;
+	uint64_t reserved;
+};
+
+struct LedgerRecord {
+	int32_t first;
+	int32_t last;
+	int32_t max_last; // max of last over this and every earlier record
+	uint32_t reason_offset;
+	double hours;     // per weekday for ranges
+	uint32_t reason_length;
+	uint8_t kind;     // LeaveKind
+	uint8_t padding[3];
+};
+
+static_assert(sizeof(LedgerImageHeader) == 40, "ledger image header layout");
+static_assert(sizeof(LedgerRecord) == 32, "ledger image record layout");
+
+bool is_ledger_image_path(const std::string& path) {
+	return fs::path(path).extension() == LEDGER_IMAGE_EXTENSION;
+}
+
+// Read-only view over ledger image bytes, wherever they live (a mapping or a buffer)
+class LedgerImage {
+public:
+	LedgerImage(const char* data, size_t size) : data_(data) {
+		const char* error = nullptr;
+		if (size < sizeof(LedgerImageHeader) || std::memcmp(header().magic, LEDGER_IMAGE_MAGIC, 4) != 0) {
+			error = "not a ledger image";
+		}
+		else if (header().version != LEDGER_IMAGE_VERSION) {
+			error = "unsupported ledger image version";
+		}
+		else if (header().heap_offset < sizeof(LedgerImageHeader) + uint64_t(header().count) * sizeof(LedgerRecord) ||
+			header().heap_offset > size || header().heap_size > size - header().heap_offset) {
+			error = "truncated ledger image";
+		}
+		if (error) {
+			throw std::runtime_error(error);
+		}
+	}
+
+	const LedgerImageHeader& header() const {
+		return *reinterpret_cast<const LedgerImageHeader*>(data_);
+	}
+
+	size_t size() const { return header().count; }
+	uint32_t content_crc() const { return header().content_crc; }
+
+	const LedgerRecord& operator[](size_t i) const {
+		return reinterpret_cast<const LedgerRecord*>(data_ + sizeof(LedgerImageHeader))[i];
+	}
+
+	std::string reason(size_t i) const {
+		const LedgerRecord& record = (*this)[i];
+		if (uint64_t(record.reason_offset) + record.reason_length > header().heap_size) {
+			throw std::runtime_error("corrupt reason in ledger image");
+		}
+		return std::string(data_ + header().heap_offset + record.reason_offset, record.reason_length);
+	}
+
+	// True if any record covers the day: the last record starting by then tells, via max_last
+	bool contains(Date day) const {
+		size_t lo = 0;
+		size_t hi = size();
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if ((*this)[mid].first <= day.days) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+		return lo > 0 && (*this)[lo - 1].max_last >= day.days;
+	}
+
+	// Copies the records into a store (in start order) for paths that edit the ledger
+	LeaveStore to_store() const {
+		ScopedPhase phase(Phase::Parse);
+		LeaveStore store;
+		store.reserve(size());
+		for (size_t i = 0; i < size(); ++i) {
+			const LedgerRecord& record = (*this)[i];
+			store.add(Date(record.first), Date(record.last), record.hours, static_cast<LeaveKind>(record.kind), reason(i));
+		}
+		return store;
+	}
+
+	// Hours charged for days on or before `through` (by default, everything) under the given
+	// calendar, read in place
+	double hours_used(const BusinessCalendar& calendar, Date through = Date(INT32_MAX)) const {
+		double used = 0.0;
+		for (size_t i = 0; i < size() && Date((*this)[i].first) <= through; ++i) {
+			const LedgerRecord& record = (*this)[i];
+			used += record.kind == static_cast<uint8_t>(LeaveKind::SingleDay) ? record.hours
+				: calendar.count_business_days(Date(record.first), std::min(Date(record.last), through)) * record.hours;
+		}
+		return used;
+	}
+
+	static std::string encode(const LeaveStore& store) {
+		std::vector<size_t> order(store.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return store.first[a] != store.first[b] ? store.first[a] < store.first[b] : store.last[a] < store.last[b];
+		});
+
+		// Reasons are already interned, so each distinct one lands in the heap once
+		std::string heap;
+		std::vector<uint32_t> reason_offsets(store.reasons.size());
+		for (size_t id = 0; id < store.reasons.size(); ++id) {
+			reason_offsets[id] = static_cast<uint32_t>(heap.size());
+			heap += store.reasons[id];
+		}
+
+		LedgerImageHeader header = {};
+		std::memcpy(header.magic, LEDGER_IMAGE_MAGIC, 4);
+		header.version = LEDGER_IMAGE_VERSION;
+		header.count = static_cast<uint32_t>(store.size());
+		header.heap_offset = sizeof(LedgerImageHeader) + store.size() * sizeof(LedgerRecord);
+		header.heap_size = heap.size();
+
+		std::string bytes(static_cast<size_t>(header.heap_offset), '\0');
+		LedgerRecord* records = reinterpret_cast<LedgerRecord*>(&bytes[sizeof(LedgerImageHeader)]);
+		int32_t max_last = INT32_MIN;
+		for (size_t i = 0; i < order.size(); ++i) {
+			size_t e = order[i];
+			LedgerRecord& record = records[i];
+			record.first = store.first[e].days;
+			record.last = store.last[e].days;
+			max_last = std::max(max_last, record.last);
+			record.max_last = max_last;
+			record.hours = store.hours[e];
+			record.kind = static_cast<uint8_t>(store.kind[e]);
+			record.reason_offset = reason_offsets[store.reason_id[e]];
+			record.reason_length = static_cast<uint32_t>(store.reason(e).size());
+		}
+		bytes += heap;
+		header.content_crc = crc32(bytes.data() + sizeof(LedgerImageHeader), bytes.size() - sizeof(LedgerImageHeader));
+		std::memcpy(&bytes[0], &header, sizeof(header));
+		return bytes;
+	}
+
+private:
+	const char* data_;
+};
+
+// A whole file mapped read-only into memory
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path) {
+		ScopedPhase phase(Phase::Load);
+#ifdef _WIN32
+		file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER file_size;
+		if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &file_size)) {
+			throw std::runtime_error("Cannot open " + path + ".");
+		}
+		size_ = static_cast<size_t>(file_size.QuadPart);
+		if (size_ > 0) {
+			mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data_ = mapping_ ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+			if (!data_) {
+				throw std::runtime_error("Cannot map " + path + ".");
+			}
+		}
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0 || ::fstat(fd, &st) != 0) {
+			if (fd >= 0) {
+				::close(fd);
+			}
+			throw std::runtime_error("Cannot open " + path + ".");
+		}
+		size_ = static_cast<size_t>(st.st_size);
+		if (size_ > 0) {
+			void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped == MAP_FAILED) {
+				::close(fd);
+				throw std::runtime_error("Cannot map " + path + ".");
+			}
+			data_ = static_cast<const char*>(mapped);
+		}
+		::close(fd); // the mapping keeps the file alive
+#endif
+	}
+
+	~MappedFile() {
+#ifdef _WIN32
+		if (data_) {
+			UnmapViewOfFile(data_);
+		}
+		if (mapping_) {
+			CloseHandle(mapping_);
+		}
+		if (file_ != INVALID_HANDLE_VALUE) {
+			CloseHandle(file_);
+		}
+#else
+		if (data_) {
+			::munmap(const_cast<char*>(data_), size_);
+		}
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+#ifdef _WIN32
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = nullptr;
+#endif
+};
+
+// A .ptol ledger mapped and queried in place
+class MappedLedger {
+public:
+	explicit MappedLedger(const std::string& path) : file_(path), image_(file_.data(), file_.size()) {}
+
+	const LedgerImage& image() const { return image_; }
+
+private:
+	MappedFile file_;
+	LedgerImage image_;
+};
+
+bool save_days_off(const std::string& path, const LeaveStore& days_off) {
+	ScopedPhase phase(Phase::Save);
+	if (is_ledger_image_path(path)) {
+		return write_file_atomic(path, LedgerImage::encode(days_off));
+	}
+	return save_document(path, days_off.to_json());
+}
+
+// Whether the ledger's journal holds edits not yet folded into the snapshot
+bool has_journaled_edits(const std::string& snapshot_path) {
+	// A journal with nothing after its "<crc> base <crc>" line is 23 bytes
+	std::error_code ec;
+	uintmax_t size = fs::file_size(snapshot_path + ".journal", ec);
+	return !ec && size > 23;
+}
+
+// Extra holiday dates from usholidays.json (or a binary sibling): a JSON array of
+// {"name", "date"} objects. None if the file is missing.
+std::map<Date, std::string> load_holiday_dates(const std::string& path) {
+	std::map<Date, std::string> days;
+	std::string found = find_document(path);
+	if (!fs::exists(found)) {
+		return days;
+	}
+	for (const auto& holiday : load_document(found)) {
+		days[Date::parse(holiday["date"])] = holiday.value("name", "Holiday");
+	}
+	return days;
+}
+
+// The rule set named by a ledger's "holiday_rules" setting. Without one the calendar is
+// weekends plus usholidays.json, as before the rules existed.
+const HolidayRuleSet& holiday_rules_for(const json& settings) {
+	std::string name = settings.value("holiday_rules", "none");
+	const HolidayRuleSet* set = find_holiday_rule_set(name);
+	if (!set) {
+		throw std::runtime_error("Unknown holiday_rules \"" + name + "\" (use us_federal or none).");
+	}
+	return *set;
+}
+
+// One calendar per rule set, all sharing the extra holiday dates. Built before any worker
+// starts, so ledgers with different rules can look theirs up concurrently.
+class HolidayCalendars {
+public:
+	explicit HolidayCalendars(const std::map<Date, std::string>& extra_holidays) {
+		for (const HolidayRuleSet& set : HOLIDAY_RULE_SETS) {
+			calendars_.emplace_back(new BusinessCalendar(set, extra_holidays));
+		}
+	}
+
+	const BusinessCalendar& for_settings(const json& settings) const {
+		const HolidayRuleSet& set = holiday_rules_for(settings);
+		return *calendars_[static_cast<size_t>(&set - HOLIDAY_RULE_SETS)];
+	}
+
+private:
+	std::vector<std::unique_ptr<BusinessCalendar>> calendars_;
+};
+
+// The days_off file next to the given default: its extension follows the "ledger_format"
+// setting (json, cbor, msgpack or ptol) when there is one, otherwise whichever format exists
+std::string days_off_path_for(const std::string& default_path, const json& settings) {
+	std::string image_path = fs::path(default_path).replace_extension(LEDGER_IMAGE_EXTENSION).string();
+	std::string name = settings.value("ledger_format", "");
+	if (name.empty()) {
+		std::string path = find_document(default_path);
+		return !fs::exists(path) && fs::exists(image_path) ? image_path : path;
+	}
+	if (name == LEDGER_IMAGE_EXTENSION + 1) {
+		return image_path;
+	}
+	DocumentFormat format;
+	if (!parse_format_name(name, format)) {
+		throw std::runtime_error("Unknown ledger_format \"" + name + "\" (use json, cbor, msgpack or ptol).");
+	}
+	return with_format_extension(default_path, format);
+}
+
+// Journal size past which an edit folds the journal back into the snapshot
+const uintmax_t JOURNAL_COMPACT_BYTES = 1 << 20;
+
+// A days_off snapshot plus an append-only journal of edits (<snapshot>.journal). Each journal
+// line is "<crc32 hex> <record>": the first record is "base <snapshot crc32>", naming the
+// snapshot it applies to, then "add <entry json>" or "remove <date>" per edit. Loading replays
+// the journal over the snapshot and stops at the first torn or corrupt record; compaction
+// writes a fresh snapshot and starts a new journal.
+class LedgerFile {
+public:
+	explicit LedgerFile(std::string snapshot_path)
+		: snapshot_path_(std::move(snapshot_path)), journal_path_(snapshot_path_ + ".journal") {}
+
+	const std::string& snapshot_path() const { return snapshot_path_; }
+	const std::string& journal_path() const { return journal_path_; }
+
+	// Reads the snapshot (missing means empty) and replays the journal over it. Throws on a
+	// snapshot that does not parse. Without reasons the store is only good for reading: it
+	// cannot be journaled against or compacted.
+	LeaveStore load(bool with_reasons = true) {
+		std::string snapshot = read_file(snapshot_path_);
+		LeaveStore store;
+		if (is_ledger_image_path(snapshot_path_) && !snapshot.empty()) {
+			LedgerImage image(snapshot.data(), snapshot.size());
+			snapshot_crc_ = image.content_crc();
+			store = image.to_store();
+		}
+		else {
+			snapshot_crc_ = crc32(snapshot);
+			if (!snapshot.empty()) {
+				store = decode_leave_store(snapshot, format_for_path(snapshot_path_), with_reasons);
+			}
+		}
+		replay(store);
+		loaded_ = true;
+		complete_ = with_reasons;
+		return store;
+	}
+
+	bool append_add(const LeaveStore& store, size_t i) {
+		return append("add " + store.entry_json(i).dump(), store);
+	}
+
+	bool append_remove(Date day, const LeaveStore& store) {
+		return append("remove " + day.to_string(), store);
+	}
+
+	// Folds the journal into a new snapshot of the given (fully replayed) store
+	bool compact(const LeaveStore& store) {
+		if (!complete_) {
+			std::cerr << "Error: " << snapshot_path_ << " was loaded without reasons and cannot be rewritten.\n";
+			return false;
+		}
+		if (!save_days_off(snapshot_path_, store)) {
+			return false;
+		}
+		std::string snapshot = read_file(snapshot_path_);
+		snapshot_crc_ = is_ledger_image_path(snapshot_path_) ? LedgerImage(snapshot.data(), snapshot.size()).content_crc() : crc32(snapshot);
+		return start_journal();
+	}
+
+private:
+	static std::string format_record(const std::string& record) {
+		char crc_hex[9];
+		std::snprintf(crc_hex, sizeof(crc_hex), "%08x", crc32(record));
+		return std::string(crc_hex) + " " + record + "\n";
+	}
+
+	// Splits "<crc> <record>" and checks the crc; false for torn or corrupt lines
+	static bool parse_record(const std::string& line, std::string& record) {
+		if (line.size() < 10 || line[8] != ' ') {
+			return false;
+		}
+		record = line.substr(9);
+		return std::strtoul(line.substr(0, 8).c_str(), nullptr, 16) == crc32(record);
+	}
+
+	void replay(LeaveStore& store) {
+		ScopedPhase phase(Phase::Parse);
+		journal_records_ = 0;
+		journal_matches_ = false;
+		std::ifstream ifs(journal_path_, std::ios::binary);
+		if (!ifs) {
+			return;
+		}
+		std::string line;
+		std::string record;
+		if (!std::getline(ifs, line) || !parse_record(line, record) || record.compare(0, 5, "base ") != 0) {
+			std::cerr << "Warning: Ignoring unreadable journal " << journal_path_ << "\n";
+			return;
+		}
+		if (std::strtoul(record.c_str() + 5, nullptr, 16) != snapshot_crc_) {
+			// Either compaction stopped between the two renames or the snapshot was edited by hand
+			std::cerr << "Warning: Journal " << journal_path_ << " was written for a different snapshot; ignoring it\n";
+			return;
+		}
+		journal_matches_ = true;
+		valid_bytes_ = static_cast<uintmax_t>(ifs.tellg());
+		while (std::getline(ifs, line)) {
+			if (ifs.eof() || !parse_record(line, record)) {
+				std::cerr << "Warning: Dropping torn or corrupt journal tail in " << journal_path_ << "\n";
+				torn_ = true;
+				break;
+			}
+			if (record.compare(0, 4, "add ") == 0) {
+				store.add_json(json::parse(record.substr(4)));
+			}
+			else if (record.compare(0, 7, "remove ") == 0) {
+				store.remove_starting_on(Date::parse(record.substr(7)));
+			}
+			journal_records_++;
+			valid_bytes_ = static_cast<uintmax_t>(ifs.tellg());
+		}
+	}
+
+	// Replaces the journal with one that only names the current snapshot. A stale journal is
+	// kept as <journal>.stale rather than thrown away.
+	bool start_journal() {
+		std::error_code ec;
+		if (loaded_ && !journal_matches_ && fs::exists(journal_path_)) {
+			fs::rename(journal_path_, journal_path_ + ".stale", ec);
+		}
+		char base[16];
+		std::snprintf(base, sizeof(base), "base %08x", snapshot_crc_);
+		if (!write_file_atomic(journal_path_, format_record(base))) {
+			return false;
+		}
+		journal_matches_ = true;
+		journal_records_ = 0;
+		torn_ = false;
+		return true;
+	}
+
+	bool append(const std::string& record, const LeaveStore& store) {
+		ScopedPhase phase(Phase::Save);
+		if (!complete_) {
+			std::cerr << "Error: " << snapshot_path_ << " was loaded without reasons and cannot be edited.\n";
+			return false;
+		}
+		if (!journal_matches_ && !start_journal()) {
+			return false;
+		}
+		std::error_code ec;
+		if (torn_) {
+			// Cut the bad tail off so new records do not land after it
+			fs::resize_file(journal_path_, valid_bytes_, ec);
+			if (ec) {
+				std::cerr << "Error: Unable to truncate " << journal_path_ << ": " << ec.message() << "\n";
+				return false;
+			}
+			torn_ = false;
+		}
+		{
+			std::ofstream ofs(journal_path_, std::ios::binary | std::ios::app);
+			if (!ofs || !(ofs << format_record(record)).flush()) {
+				std::cerr << "Error: Unable to append to " << journal_path_ << "\n";
+				return false;
+			}
+		}
+		journal_records_++;
+		if (fs::file_size(journal_path_, ec) > JOURNAL_COMPACT_BYTES && !ec) {
+			return compact(store);
+		}
+		return true;
+	}
+
+	std::string snapshot_path_;
+	std::string journal_path_;
+	uint32_t snapshot_crc_ = 0;
+	size_t journal_records_ = 0;
+	uintmax_t valid_bytes_ = 0;
+	bool journal_matches_ = false;
+	bool torn_ = false;
+	bool loaded_ = false;
+	bool complete_ = true;
+};
+
+// Writes tables in the same boxed layout as tabulate::Table ("+----+" borders, "| cell |"
+// rows) one row at a time through a fixed-size buffer. Column widths are given up front,
+// usually measured with widen() in a first pass over the rows, so nothing is kept per row.
+class TableWriter {
+public:
+	TableWriter(std::ostream& out, std::vector<size_t> widths) : out_(out), widths_(std::move(widths)) {
+		buffer_.reserve(BUFFER_BYTES + 1024);
+		for (size_t width : widths_) {
+			border_ += '+';
+			border_.append(width + 2, '-');
+		}
+		border_ += "+\n";
+		buffer_ += border_;
+	}
+
+	~TableWriter() {
+		flush();
+	}
+
+	TableWriter(const TableWriter&) = delete;
+	TableWriter& operator=(const TableWriter&) = delete;
+
+	// Width of text in columns: UTF-8 code points, not bytes
+	static size_t display_width(const std::string& text) {
+		size_t width = 0;
+		for (char c : text) {
+			width += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+		}
+		return width;
+	}
+
+	// Grows widths to fit a row
+	static void widen(std::vector<size_t>& widths, std::initializer_list<std::string> cells) {
+		widen(widths, cells.begin(), cells.end());
+	}
+
+	static void widen(std::vector<size_t>& widths, const std::vector<std::string>& cells) {
+		widen(widths, cells.begin(), cells.end());
+	}
+
+	void row(std::initializer_list<std::string> cells) {
+		row(cells.begin(), cells.end());
+	}
+
+	void row(const std::vector<std::string>& cells) {
+		row(cells.begin(), cells.end());
+	}
+
+	void flush() {
+		out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+		buffer_.clear();
+	}
+
+private:
+	static const size_t BUFFER_BYTES = 64 * 1024;
+
+	template <typename It>
+	static void widen(std::vector<size_t>& widths, It begin, It end) {
+		widths.resize(std::max(widths.size(), static_cast<size_t>(end - begin)), 0);
+		for (size_t column = 0; begin != end; ++begin, ++column) {
+			widths[column] = std::max(widths[column], display_width(*begin));
+		}
+	}
+
+	template <typename It>
+	void row(It begin, It end) {
+		for (size_t column = 0; begin != end; ++begin, ++column) {
+			size_t width = display_width(*begin);
+			buffer_ += "| ";
+			buffer_ += *begin;
+			buffer_.append(widths_[column] > width ? widths_[column] - width + 1 : 1, ' ');
+		}
+		buffer_ += "|\n";
+		buffer_ += border_;
+		if (buffer_.size() >= BUFFER_BYTES) {
+			flush();
+		}
+	}
+
+	std::ostream& out_;
+	std::vector<size_t> widths_;
+	std::string border_;
+	std::string buffer_;
+};
+
+// Writes a small table whose rows are already at hand
+void write_table(std::ostream& out, const std::vector<std::vector<std::string>>& rows) {
+	std::vector<size_t> widths;
+	for (const auto& cells : rows) {
+		TableWriter::widen(widths, cells);
+	}
+	TableWriter table(out, widths);
+	for (const auto& cells : rows) {
+		table.row(cells);
+	}
+}
+
+// How command output is written: the human tables, or records for other programs
+enum class OutputFormat { Table, Json, NdJson, Csv };
+
+bool parse_output_format(const std::string& name, OutputFormat& format) {
+	const std::pair<const char*, OutputFormat> names[] = {
+		{ "table", OutputFormat::Table }, { "json", OutputFormat::Json },
+		{ "ndjson", OutputFormat::NdJson }, { "csv", OutputFormat::Csv },
+	};
+	for (const auto& entry : names) {
+		if (name == entry.first) {
+			format = entry.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Streams flat records as one JSON array, one JSON object per line (NDJSON), or CSV under a
+// header row. Values are escaped straight into a fixed-size buffer rather than going through
+// a json document. Each record gives its fields in the order of the columns named up front.
+class RecordWriter {
+public:
+	RecordWriter(std::ostream& out, OutputFormat format, std::vector<std::string> columns)
+		: out_(out), format_(format), columns_(std::move(columns)) {
+		buffer_.reserve(BUFFER_BYTES + 1024);
+		if (format_ == OutputFormat::Json) {
+			buffer_ += '[';
+		}
+		else if (format_ == OutputFormat::Csv) {
+			for (size_t i = 0; i < columns_.size(); ++i) {
+				buffer_ += i == 0 ? "" : ",";
+				append_csv(columns_[i]);
+			}
+			buffer_ += '\n';
+		}
+	}
+
+	~RecordWriter() {
+		finish();
+	}
+
+	RecordWriter(const RecordWriter&) = delete;
+	RecordWriter& operator=(const RecordWriter&) = delete;
+
+	RecordWriter& field(const std::string& value) {
+		begin_field();
+		if (format_ == OutputFormat::Csv) {
+			append_csv(value);
+		}
+		else {
+			append_json_string(value);
+		}
+		return *this;
+	}
+
+	RecordWriter& field(const char* value) {
+		return field(std::string(value));
+	}
+
+	// A missing value: null, or an empty CSV field
+	RecordWriter& null() {
+		begin_field();
+		buffer_ += format_ == OutputFormat::Csv ? "" : "null";
+		return *this;
+	}
+
+	RecordWriter& field(double value) {
+		if (!std::isfinite(value)) {
+			return null();
+		}
+		begin_field();
+		// Fewest digits (from 15) that read back as the same double
+		char text[32];
+		for (int digits = 15; digits <= 17; ++digits) {
+			std::snprintf(text, sizeof(text), "%.*g", digits, value);
+			if (std::strtod(text, nullptr) == value) {
+				break;
+			}
+		}
+		buffer_ += text;
+		return *this;
+	}
+
+	RecordWriter& field(int value) {
+		begin_field();
+		buffer_ += std::to_string(value);
+		return *this;
+	}
+
+	RecordWriter& field(bool value) {
+		begin_field();
+		buffer_ += value ? "true" : "false";
+		return *this;
+	}
+
+	void end_record() {
+		if (format_ != OutputFormat::Csv) {
+			buffer_ += '}';
+		}
+		if (format_ != OutputFormat::Json) {
+			buffer_ += '\n';
+		}
+		column_ = 0;
+		records_++;
+		if (buffer_.size() >= BUFFER_BYTES) {
+			flush();
+		}
+	}
+
+	// Closes the JSON array and writes out whatever is buffered; later calls do nothing
+	void finish() {
+		if (finished_) {
+			return;
+		}
+		if (format_ == OutputFormat::Json) {
+			buffer_ += records_ == 0 ? "]\n" : "\n]\n";
+		}
+		flush();
+		finished_ = true;
+	}
+
+private:
+	static const size_t BUFFER_BYTES = 64 * 1024;
+
+	void begin_field() {
+		if (format_ == OutputFormat::Csv) {
+			buffer_ += column_ == 0 ? "" : ",";
+		}
+		else {
+			if (column_ == 0 && format_ == OutputFormat::Json) {
+				buffer_ += records_ == 0 ? "\n" : ",\n";
+			}
+			if (column_ == 0) {
+				buffer_ += '{';
+			}
+			else {
+				buffer_ += ',';
+			}
+			append_json_string(columns_[column_]);
+			buffer_ += ':';
+		}
+		column_++;
+	}
+
+	void append_json_string(const std::string& value) {
+		buffer_ += '"';
+		for (char c : value) {
+			switch (c) {
+			case '"': buffer_ += "\\\""; break;
+			case '\\': buffer_ += "\\\\"; break;
+			case '\n': buffer_ += "\\n"; break;
+			case '\r': buffer_ += "\\r"; break;
+			case '\t': buffer_ += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+					buffer_ += escaped;
+				}
+				else {
+					buffer_ += c;
+				}
+			}
+		}
+		buffer_ += '"';
+	}
+
+	// Quotes a value only when it holds a comma, quote or line break
+	void append_csv(const std::string& value) {
+		if (value.find_first_of(",\"\r\n") == std::string::npos) {
+			buffer_ += value;
+			return;
+		}
+		buffer_ += '"';
+		for (char c : value) {
+			buffer_ += c;
+			if (c == '"') {
+				buffer_ += '"';
+			}
+		}
+		buffer_ += '"';
+	}
+
+	void flush() {
+		out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+		buffer_.clear();
+	}
+
+	std::ostream& out_;
+	OutputFormat format_;
+	std::vector<std::string> columns_;
+	std::string buffer_;
+	size_t column_ = 0;
+	size_t records_ = 0;
+	bool finished_ = false;
+};
+
+void list_days_off(const LeaveStore& days_off) {
+	ScopedPhase phase(Phase::Render);
+	if (days_off.empty()) {
+		std::cout << "No days off recorded.\n";
+		return;
+	}
+	std::cout << "-------------------------------------------------------------------------------\n";
+	std::cout << std::left << std::setw(25) << "Date/Range"
+		<< std::right << std::setw(18) << "Type"
+		<< std::right << std::setw(14) << "Hours"
+		<< std::right << std::setw(20) << "Reason" << "\n";
+	std::cout << "-------------------------------------------------------------------------------\n";
+	for (size_t i = 0; i < days_off.size(); ++i) {
+		if (days_off.kind[i] == LeaveKind::SingleDay) {
+			std::cout << std::left << std::setw(25) << days_off.first[i].to_string()
+				<< std::right << std::setw(18) << "Single Day"
+				<< std::right << std::setw(14) << days_off.hours[i]
+				<< std::right << std::setw(20) << days_off.reason(i)
+				<< "\n";
+		}
+		else {
+			std::string range = days_off.first[i].to_string() + " to " + days_off.last[i].to_string();
+			std::cout << std::left << std::setw(25) << range
+				<< std::right << std::setw(18) << "Range"
+				<< std::right << std::setw(14) << days_off.hours[i]
+				<< std::right << std::setw(20) << days_off.reason(i)
+				<< "\n";
+		}
+	}
+	std::cout << "-------------------------------------------------------------------------------\n";
+}
+
+// Days off as records, in the order they were logged
+void write_days_off_records(const LeaveStore& days_off, const BusinessCalendar& calendar, OutputFormat format) {
+	ScopedPhase phase(Phase::Render);
+	RecordWriter records(std::cout, format, { "start_date", "end_date", "type", "hours_per_day", "total_hours", "reason" });
+	for (size_t i = 0; i < days_off.size(); ++i) {
+		bool single = days_off.kind[i] == LeaveKind::SingleDay;
+		records.field(days_off.first[i].to_string()).field(days_off.last[i].to_string())
+			.field(single ? "single_day" : "range").field(days_off.hours[i])
+			.field(single ? days_off.hours[i] : days_off.total_hours(i, calendar)).field(days_off.reason(i));
+		records.end_record();
+	}
+}
+
+// Print the days that have been taken off as a table, measuring the columns in a first pass
+void list_days_off_tabulate(const LeaveStore& days_off, const BusinessCalendar& calendar) {
+	ScopedPhase phase(Phase::Render);
+	std::cout << "Logged Time Off\n";
+	auto time_off = [&](size_t i) {
+		return format_hrs(days_off.kind[i] == LeaveKind::SingleDay ? days_off.hours[i] : days_off.total_hours(i, calendar));
+	};
+	std::vector<size_t> widths;
+	TableWriter::widen(widths, { "Date/Range", "Type", "Time Off", "Reason" });
+	for (size_t i = 0; i < days_off.size(); ++i) {
+		bool single = days_off.kind[i] == LeaveKind::SingleDay;
+		TableWriter::widen(widths, { std::string(single ? 10 : 24, ' '), single ? "Single Day" : "Range", time_off(i), days_off.reason(i) });
+	}
+	TableWriter table(std::cout, widths);
+	table.row({ "Date/Range", "Type", "Time Off", "Reason" });
+	for (size_t i = 0; i < days_off.size(); ++i) {
+		if (days_off.kind[i] == LeaveKind::SingleDay) {
+			table.row({ days_off.first[i].to_string(), "Single Day", time_off(i), days_off.reason(i) });
+		}
+		else {
+			std::string range = days_off.first[i].to_string() + " to " + days_off.last[i].to_string();
+			table.row({ range, "Range", time_off(i), days_off.reason(i) });
+		}
+	}
+	table.flush();
+	std::cout << "\n";
+}
+
+void print_usage() {
+	std::cout << "Usage (date format used: yyyy-mm-dd):\n"
+		<< "  pto                        Show available PTO\n"
+		<< "  pto add <date> [hours]     Add a day off (default: 8 hours)\n"
+		<< "  pto add_range <start> <end> [hours/day]  Add range of days off (default: 8)\n"
+		<< "  pto is_day_off <date>      Show whether a date falls in any recorded day off\n"
+		<< "  pto remove <date>          Remove entries matching a date (exact match to 'date' or 'start_date')\n"
+		<< "  pto show_days_off          Show all saved days off\n"
+		<< "  pto show_hrs_on <date> [end]  Show the balance on a date, or on each weekday from date to end\n"
+		<< "  pto compact                Fold journaled edits (days_off.json.journal) into days_off.json\n"
+		<< "  pto convert <in> <out>     Convert settings or days off between .json, .cbor and .msgpack (days off also .ptol)\n"
+		<< "  pto bench [max_entries] [tenure_years] [range_ratio] [holidays_per_year]\n"
+		<< "                             Time the hot paths on synthetic ledgers of 10 to max_entries entries\n"
+		<< "  pto selftest               Check the date math against day-by-day reference loops and under\n"
+		<< "                             several TZ values, with PTO_TODAY pinned and from the clock\n"
+		<< "  pto bench_formats [n]      Time parsing and size of each ledger format on n synthetic entries\n"
+		<< "  pto optimize <pto_days> [months] [top_k] [max_breaks]\n"
+		<< "                             Best places to book PTO days over the next months (default 12) for the most days off\n"
+		<< "  pto batch <dir|manifest>   Show summaries for every ledger directory (settings.json + days_off.json)\n"
+		<< "  pto liability <dir|manifest> [as_of]  Unused PTO (balance x hourly_rate) by department and cost center\n"
+		<< "                             as of a date: unlike the summary and batch, leave booked after it is not deducted\n"
+		<< "  pto forecast <dir|manifest> <date> [trajectories] [seed] [department]\n"
+		<< "                             P10/P50/P90 balances on a date, simulating leave fitted from the past year\n"
+		<< "  pto import <dir|manifest> <file.csv|file.ndjson|file.json>\n"
+		<< "                             Add leave rows (employee, date or start_date, end_date, hours, reason)\n"
+		<< "                             to each employee's ledger, rejecting invalid or overlapping rows\n"
+		<< "  pto serve <dir|manifest> <socket>  Keep those ledgers in memory and answer JSON requests on a Unix socket\n"
+		<< "  pto usage                  Show this help message\n\n"
+		<< "Set \"ledger_format\": \"cbor\" (or \"msgpack\") in settings to keep days off in a binary file,\n"
+		<< "or \"ptol\" for a memory-mapped image that read-only commands query without parsing.\n"
+		<< "Set \"holiday_rules\": \"us_federal\" in settings to generate US federal holidays for every year;\n"
+		<< "usholidays.json can list extra dates. Holidays neither accrue nor cost PTO, and cannot be added as days off.\n"
+		<< "An \"accrual_policy\" in settings replaces the flat accrual_rate_per_day with tenure \"tiers\"\n"
+		<< "([{\"after_years\": 3, \"rate_per_day\": 0.8}, ...]), a \"cap_hours\" balance cap, \"grant_every_days\" and\n"
+		<< "\"carryover_hours\" (the balance above it expires each anniversary; add, add_range, remove and import keep\n"
+		<< "yearly checkpoints in <days off>.checkpoints so summaries only replay the current year).\n"
+		<< "Set PTO_TODAY=yyyy-mm-dd to compute as of a fixed date instead of the host clock.\n"
+		<< "Add --format json, ndjson or csv to the summary, show_hrs_on, is_day_off, show_days_off, optimize, batch, liability or forecast\n"
+		<< "for records instead of tables: json writes one array of records; ndjson writes one record per line.\n"
+		<< "Add --profile to any command to print the time and allocations spent loading, parsing,\n"
+		<< "computing, rendering and saving to stderr when it finishes.\n\n";
+}
+
+// Show the balance on a date: hours accrued since hire minus days off taken on or before it.
+// Given an end date too, show the balance for every business day in [date, end].
+void show_hrs_on(const BalanceTimeline& timeline, const BusinessCalendar& calendar, const std::string& date, const std::string& end_date, OutputFormat format = OutputFormat::Table) {
+    ScopedPhase phase(Phase::Render);
+    Date target = Date::parse(date);
+    Date end = end_date.empty() ? target : Date::parse(end_date);
+    if (end < target) {
+        std::cerr << "Error: The end date is before the start date.\n";
+        return;
+    }
+
+    // should this matter?
+    if (end_date.empty() && !calendar.is_business_day(target)) {
+        std::cerr << "Error: Trying to show a date that is a weekend or holiday.\n";
+        return;
+    }
+
+    if (format != OutputFormat::Table) {
+        RecordWriter records(std::cout, format, { "date", "accrued", "used", "balance" });
+        for (Date d = target; d <= end; ++d) {
+            if (calendar.is_business_day(d)) {
+                records.field(d.to_string()).field(timeline.accrued_on(d)).field(timeline.used_through(d)).field(timeline.balance_on(d));
+                records.end_record();
+            }
+        }
+        return;
+    }
+
+    if (end_date.empty()) {
+        std::cout << "Accrued hours to then: " << format_hrs(timeline.balance_on(target)) << " hours.\n";
+        return;
+    }
+
+    std::vector<size_t> widths;
+    TableWriter::widen(widths, { "Date", "Time Balance" });
+    for (Date d = target; d <= end; ++d) {
+        if (calendar.is_business_day(d)) {
+            TableWriter::widen(widths, { d.to_string(), format_hrs(timeline.balance_on(d)) });
+        }
+    }
+    TableWriter table(std::cout, widths);
+    table.row({ "Date", "Time Balance" });
+    for (Date d = target; d <= end; ++d) {
+        if (calendar.is_business_day(d)) {
+            table.row({ d.to_string(), format_hrs(timeline.balance_on(d)) });
+        }
+    }
+    table.flush();
+}
+
+void print_is_day_off(const std::string& date, bool off, OutputFormat format = OutputFormat::Table) {
+	ScopedPhase phase(Phase::Render);
+	if (format != OutputFormat::Table) {
+		RecordWriter records(std::cout, format, { "date", "day_off" });
+		records.field(date).field(off).end_record();
+		return;
+	}
+	std::cout << date << (off ? " is a day off.\n" : " is not a day off.\n");
+}
+
+// Why a single day off cannot be added, or an empty string if it can
+std::string day_off_conflict(const DaysOffIndex& index, Date day) {
+	if (is_day_off(index, day)) {
+		return "A time-off entry for " + day.to_string() + " already exists.";
+	}
+	if (!is_weekday(day)) {
+		return "Trying to add a date that is a weekend.";
+	}
+	std::string holiday = index.calendar().holiday_name(day);
+	if (!holiday.empty()) {
+		return day.to_string() + " is a holiday (" + holiday + ").";
+	}
+	return std::string();
+}
+
+// Why a range of days off cannot be added, or an empty string if it can
+std::string range_days_off_conflict(const DaysOffIndex& index, Date start_day, Date end_day) {
+	if (end_day < start_day) {
+		return "The end_date is before the start_date.";
+	}
+	std::vector<size_t> clashes = index.overlapping(start_day, end_day);
+	if (!clashes.empty()) {
+		const LeaveSpan& clash = index[clashes.front()];
+		std::string span = clash.first.to_string();
+		if (!clash.single_day) {
+			span += " to " + clash.last.to_string();
+		}
+		return "The range overlaps an existing time-off entry (" + span + ").";
+	}
+	if (!index.calendar().is_business_day(start_day)) {
+		return "Trying to add a start_date that is a weekend or holiday.";
+	}
+	if (!index.calendar().is_business_day(end_day)) {
+		return "Trying to add a end_date that is a weekend or holiday.";
+	}
+	return std::string();
+}
+
+// Add a single day off; false if it was refused or could not be saved
+bool add_day_off(LeaveStore& days_off, const DaysOffIndex& index, LedgerFile& file, const std::string& date, double hours, const std::string& reason) {
+    Date day = Date::parse(date);
+    std::string conflict = day_off_conflict(index, day);
+    if (!conflict.empty()) {
+        std::cerr << "Error: " << conflict << "\n";
+        return false;
+    }
+    days_off.add(day, day, hours, LeaveKind::SingleDay, reason);
+    if (!file.append_add(days_off, days_off.size() - 1)) {
+        return false;
+    }
+    std::cout << "Added day off: " << date << " (" << hours << "h, Reason: " << reason << ")\n";
+    return true;
+}
+
+// Add a range of days off; false if it was refused or could not be saved
+bool add_range_days_off(LeaveStore& days_off, const DaysOffIndex& index, LedgerFile& file, const std::string& start, const std::string& end, double hours_per_day, const std::string& reason) {
+	Date start_day = Date::parse(start);
+	Date end_day = Date::parse(end);
+	std::string conflict = range_days_off_conflict(index, start_day, end_day);
+	if (!conflict.empty()) {
+		std::cerr << "Error: " << conflict << "\n";
+		return false;
+	}
+	days_off.add(start_day, end_day, hours_per_day, LeaveKind::Range, reason);
+	if (!file.append_add(days_off, days_off.size() - 1)) {
+		return false;
+	}
+	std::cout << "Added days off: " << start << " to " << end << " (" << hours_per_day << "h/day, Reason: " << reason << ")\n";
+	return true;
+}
+
+// Yearly checkpoints of a carryover policy's walk, kept next to the ledger in
+// "<days off file>.checkpoints". Checkpoint k is the walk's state at the k-th anniversary plus
+// a fingerprint of what the years before it depend on: the policy, then for each year its
+// business days and the leave overlapping it, chained through the previous year's
+// fingerprint. The summary resumes from the last checkpoint whose fingerprint still matches,
+// so it replays only the current year; an edit to an old year invalidates the checkpoints
+// from that year on.
+std::string checkpoint_path_for(const std::string& days_off_path) {
+	return days_off_path + ".checkpoints";
+}
+
+struct YearCheckpoint {
+	uint32_t fingerprint = 0;
+	AccrualPlan::Resume state;
+};
+
+uint32_t policy_fingerprint(const AccrualPolicy& policy) {
+	std::ostringstream key;
+	key << std::setprecision(17) << policy.hired.days << ' ' << policy.cap_hours << ' ' << policy.grant_every_days << ' '
+		<< policy.grant_anchor.days << ' ' << policy.carryover_hours;
+	for (const AccrualTier& tier : policy.tiers) {
+		key << ' ' << tier.after_years << ':' << tier.rate_per_day;
+	}
+	return crc32(key.str());
+}
+
+// Chains the year [first, last] onto the fingerprint before it; leave is taken from
+// charges_from on, so the first year also covers what was charged before the start date
+uint32_t year_fingerprint(uint32_t previous, const DaysOffIndex& index, Date first, Date last, Date charges_from) {
+	const BusinessCalendar& calendar = index.calendar();
+	// The calendar's bit words for the (at most two) years the span touches, masked to the span
+	uint32_t crc = previous;
+	for (int year = first.year(); year <= last.year(); ++year) {
+		Date jan1 = Date::from_ymd(year, 1, 1);
+		int lo = std::max(0, first - jan1);
+		int hi = last - jan1;
+		BusinessCalendar::YearBits bits = calendar.year_bits(year);
+		for (int w = 0; w < static_cast<int>(bits.size()); ++w) {
+			int from = std::max(lo - w * 64, 0);
+			int to = std::min(hi - w * 64, 63);
+			bits[w] &= from > to ? 0 : (to == 63 ? ~0ull : (1ull << (to + 1)) - 1) & (~0ull << from);
+		}
+		crc = crc32(reinterpret_cast<const char*>(bits.data()), sizeof(bits), crc);
+	}
+	for (size_t i : index.overlapping(charges_from, last)) {
+		const LeaveSpan& span = index[i];
+		double fields[] = { static_cast<double>(span.first.days), static_cast<double>(span.last.days), span.hours_per_day,
+			span.single_day ? 1.0 : 0.0, span.hours_between(charges_from, last, calendar) };
+		crc = crc32(reinterpret_cast<const char*>(fields), sizeof(fields), crc);
+	}
+	return crc;
+}
+
+json checkpoints_to_json(uint32_t policy, const std::vector<YearCheckpoint>& checkpoints) {
+	json years = json::array();
+	for (const YearCheckpoint& checkpoint : checkpoints) {
+		const AccrualPlan::Resume& state = checkpoint.state;
+		json pieces = json::array();
+		for (const AccrualPlan::Piece& piece : state.pieces) {
+			pieces.push_back({ piece.from.to_string(), piece.base, piece.rate });
+		}
+		years.push_back({ {"anniversary", state.at.to_string()}, {"fingerprint", checkpoint.fingerprint},
+			{"closing_balance", state.closing_balance}, {"expired", state.expired}, {"used", state.used},
+			{"rate", state.rate}, {"at_cap", state.at_cap}, {"pieces", pieces} });
+	}
+	return { {"policy", policy}, {"years", years} };
+}
+
+// The checkpoints stored for a policy; none if the file is missing, unreadable or was
+// written for a different policy
+std::vector<YearCheckpoint> load_checkpoints(const std::string& path, uint32_t policy) {
+	std::vector<YearCheckpoint> checkpoints;
+	if (!fs::exists(path)) {
+		return checkpoints;
+	}
+	try {
+		json document = json::parse(read_file(path));
+		if (document.at("policy").get<uint32_t>() != policy) {
+			return checkpoints;
+		}
+		for (const json& year : document.at("years")) {
+			YearCheckpoint checkpoint;
+			checkpoint.fingerprint = year.at("fingerprint").get<uint32_t>();
+			AccrualPlan::Resume& state = checkpoint.state;
+			state.at = Date::parse(year.at("anniversary").get<std::string>());
+			state.closing_balance = year.at("closing_balance").get<double>();
+			state.expired = year.at("expired").get<double>();
+			state.used = year.at("used").get<double>();
+			state.rate = year.at("rate").get<double>();
+			state.at_cap = year.at("at_cap").get<bool>();
+			for (const json& piece : year.at("pieces")) {
+				state.pieces.push_back({ Date::parse(piece.at(0).get<std::string>()), piece.at(1).get<double>(), piece.at(2).get<double>() });
+			}
+			if (state.pieces.empty()) {
+				break;
+			}
+			checkpoints.push_back(std::move(checkpoint));
+		}
+	}
+	catch (const std::exception&) {
+		checkpoints.clear();
+	}
+	return checkpoints;
+}
+
+// The plan for dates from the last anniversary on or before as_of, resumed from the stored
+// checkpoints where they are still valid. With `save`, checkpoints for anniversaries it had to
+// walk through are written back; only commands that edit the ledger save, so read-only
+// reports never write into a ledger directory.
+AccrualPlan checkpointed_plan(const AccrualPolicy& policy, const DaysOffIndex& index, const std::string& path, Date as_of, bool save) {
+	uint32_t policy_key = policy_fingerprint(policy);
+	std::vector<uint32_t> fingerprints;
+	uint32_t fingerprint = policy_key;
+	for (int year = 1; add_years(policy.hired, year) <= as_of && add_years(policy.hired, year).year() <= BusinessCalendar::LAST_YEAR; ++year) {
+		Date first = add_years(policy.hired, year - 1);
+		Date charges_from = year == 1 && index.size() > 0 ? std::min(first, index[0].first) : first;
+		fingerprint = year_fingerprint(fingerprint, index, first, add_years(policy.hired, year) - 1, charges_from);
+		fingerprints.push_back(fingerprint);
+	}
+
+	std::vector<YearCheckpoint> checkpoints = load_checkpoints(path, policy_key);
+	size_t valid = 0;
+	while (valid < checkpoints.size() && valid < fingerprints.size() && checkpoints[valid].fingerprint == fingerprints[valid] &&
+		checkpoints[valid].state.at == add_years(policy.hired, static_cast<int>(valid) + 1)) {
+		valid++;
+	}
+	AccrualPlan plan = valid == 0 ? AccrualPlan(policy, index) : AccrualPlan(policy, index, checkpoints[valid - 1].state);
+	if (save && valid < fingerprints.size()) {
+		checkpoints.resize(valid);
+		for (const AccrualPlan::Resume& state : plan.anniversaries()) {
+			if (checkpoints.size() == fingerprints.size()) {
+				break;
+			}
+			checkpoints.push_back({ fingerprints[checkpoints.size()], state });
+		}
+		write_file_atomic(path, checkpoints_to_json(policy_key, checkpoints).dump(1, '\t') + "\n");
+	}
+	return plan;
+}
+
+// Brings a carryover ledger's checkpoints up to date after an edit, so later summaries resume
+// from them
+void save_checkpoints(const json& settings, const LeaveStore& days_off, const BusinessCalendar& calendar, const std::string& days_off_path) {
+	AccrualPolicy policy = accrual_policy_for(settings);
+	if (policy.carries_over()) {
+		DaysOffIndex index(days_off, calendar);
+		checkpointed_plan(policy, index, checkpoint_path_for(days_off_path), today(), true);
+	}
+}
+
+// The figures behind the PTO summary, as of today
+struct PtoSummary {
+	double accrual_rate = 0.0;
+	int working_days = 0;
+	double accrued = 0.0;
+	double used = 0.0;
+	double expired = 0.0;
+	double balance = 0.0;
+};
+
+PtoSummary compute_pto_summary(const AccrualPlan& plan, double used_hours, const BusinessCalendar& calendar) {
+	ScopedPhase phase(Phase::Compute);
+	PtoSummary summary;
+	summary.accrual_rate = plan.rate_on(today());
+	summary.working_days = working_days_elapsed_since(plan.hired(), calendar);
+	summary.accrued = plan.accrued_on(today());
+	summary.used = used_hours;
+	summary.expired = plan.expired_through(today());
+	summary.balance = summary.accrued - summary.used - summary.expired;
+	return summary;
+}
+
+// Print the days that have been taken off and a summary
+void print_pto_summary(const json& settings, const LeaveStore& days_off, const DaysOffIndex& index, const std::string& checkpoint_path,
+    OutputFormat format = OutputFormat::Table) {
+    ScopedPhase phase(Phase::Render);
+    AccrualPolicy policy = accrual_policy_for(settings);
+    AccrualPlan plan = policy.carries_over() ? checkpointed_plan(policy, index, checkpoint_path, today(), false) : AccrualPlan(policy, index);
+    PtoSummary summary = compute_pto_summary(plan, calculate_hours_of_days_off(index), index.calendar());
+    if (format != OutputFormat::Table) {
+        RecordWriter records(std::cout, format, { "as_of", "start_date", "accrual_rate", "working_days", "accrued", "used", "expired", "balance" });
+        records.field(today().to_string()).field(settings["start_date"].get<std::string>()).field(summary.accrual_rate)
+            .field(summary.working_days).field(summary.accrued).field(summary.used).field(summary.expired).field(summary.balance);
+        records.end_record();
+        return;
+    }
+    double accrual_rate = summary.accrual_rate;
+	std::string accrual_rate_str = std::to_string(accrual_rate) + " hours/day";
+
+    double accrued_hours_since_hired = summary.accrued;
+    int working_days_since_hired = summary.working_days;
+	std::string working_days_since_hired_str = std::to_string(working_days_since_hired) + " days";
+    double hours_taken_off = summary.used;
+    double hours_available = summary.balance;
+
+    std::cout << "\n===============================================\n";
+    std::cout << "         Paid Time Off Tracker          \n";
+    std::cout <<   "===============================================\n\n";
+
+    
+    list_days_off_tabulate(days_off, index.calendar());
+
+	std::cout << "Summary\n";
+    std::vector<std::vector<std::string>> summary_table;
+    summary_table.push_back({"Accrual Rate:", accrual_rate_str});
+    summary_table.push_back({"Working Days Since Hired:", working_days_since_hired_str});
+    summary_table.push_back({"Time Accrued:", format_hrs(accrued_hours_since_hired)});
+    summary_table.push_back({"Time Used:", format_hrs(hours_taken_off)});
+    if (summary.expired > 0) {
+        summary_table.push_back({"Time Expired:", format_hrs(summary.expired)});
+    }
+    summary_table.push_back({"Time Balance:", format_hrs(hours_available)});
+	// Before a tiered policy's first paying tier starts, count at that tier's rate; with no
+	// rate ahead at all the balance never gets back to 0
+	double recovery_rate = accrual_rate;
+	for (const AccrualTier& tier : policy.tiers) {
+		if (recovery_rate <= 0 && add_years(policy.hired, tier.after_years) > today()) {
+			recovery_rate = tier.rate_per_day;
+		}
+	}
+	if (hours_available < 0 && recovery_rate > 0) {
+        int days_needed = static_cast<int>(std::ceil(std::abs(hours_available) / recovery_rate));
+		summary_table.push_back({"Days Needed To Get To 0:", std::to_string(days_needed)});
+    }
+    if (hours_available > 40) {
+		summary_table.push_back({"You Have A Problem", "YES, YOU SHOULD TAKE SOME VACATION!"});
+    }
+    write_table(std::cout, summary_table);
+
+
+    std::cout << std::endl;
+}
+
+// A made-up ledger of `entries` days off after `start`: one entry starting on a weekday about
+// every `spacing` days, with `range_ratio` of them multi-day ranges. Entries never overlap
+// unless spacing is below a day, when several start on the same day and ranges overlap.
+LeaveStore make_synthetic_ledger(size_t entries, double range_ratio = 0.25, uint32_t seed = 42,
+	Date start = Date::from_ymd(2000, 1, 3), double spacing = 3.0) {
+	LeaveStore store;
+	store.reserve(entries);
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	const char* reasons[] = { "vacation", "sick", "appointment", "family", "" };
+	bool disjoint = spacing >= 1.0;
+	Date day = start;
+	for (size_t i = 0; i < entries; ++i) {
+		day = day + (disjoint ? 1 + static_cast<int>(unit(rng) * 2.0 * (spacing - 1.0)) : (unit(rng) < spacing ? 1 : 0));
+		while (!is_weekday(day)) {
+			++day;
+		}
+		const char* reason = reasons[rng() % 5];
+		if (unit(rng) < range_ratio) {
+			Date end = day + 1 + static_cast<int>(rng() % 6);
+			store.add(day, end, 8.0, LeaveKind::Range, reason);
+			if (disjoint) {
+				day = end;
+			}
+		}
+		else {
+			store.add(day, day, (rng() % 2) ? 8.0 : 4.0, LeaveKind::SingleDay, reason);
+		}
+	}
+	return store;
+}
+
+// Encode/decode time and size of a ledger in each format, against the text snapshot
+void bench_formats(size_t entries) {
+	using clock = std::chrono::steady_clock;
+	json days_off = make_synthetic_ledger(entries).to_json();
+	std::cout << "Ledger of " << entries << " entries\n";
+	std::vector<std::vector<std::string>> table;
+	table.push_back({ "Format", "Size", "Encode", "Decode", "Decode + LeaveStore" });
+	for (DocumentFormat format : ALL_DOCUMENT_FORMATS) {
+		auto t0 = clock::now();
+		std::string bytes = encode_document(days_off, format);
+		auto t1 = clock::now();
+		json decoded = decode_document(bytes, format);
+		auto t2 = clock::now();
+		LeaveStore store = LeaveStore::from_json(decode_document(bytes, format));
+		auto t3 = clock::now();
+		auto ms = [](clock::duration d) {
+			std::ostringstream oss;
+			oss << std::fixed << std::setprecision(1) << std::chrono::duration<double, std::milli>(d).count() << " ms";
+			return oss.str();
+		};
+		std::ostringstream size;
+		size << std::fixed << std::setprecision(1) << bytes.size() / 1024.0 << " KiB";
+		table.push_back({ format_name(format), size.str(), ms(t1 - t0), ms(t2 - t1), ms(t3 - t2) });
+		if (decoded != days_off || store.size() != entries) {
+			std::cerr << "Error: " << format_name(format) << " did not round-trip.\n";
+		}
+	}
+	write_table(std::cout, table);
+}
+
+// Shape of a made-up ledger for `pto bench`, plus a calendar with holidays_per_year random
+// weekday holidays
+struct SyntheticLedgerSpec {
+	size_t entries = 1000;
+	int tenure_years = 10;       // stretched when the entries do not fit without overlapping
+	double range_ratio = 0.25;
+	int holidays_per_year = 11;  // weekday holidays in the calendar
+	uint32_t seed = 42;
+
+	// Hired tenure_years before 2025
+	Date hired() const { return Date::from_ymd(2025 - tenure_years, 1, 2); }
+
+	// Mean distance between entry starts to spread them over the tenure, no closer than an
+	// entry's own length allows. Packed closer when that would run past the last year the
+	// calendar caches: below a day apart (overlapping) for the largest sizes.
+	double spacing() const {
+		double count = static_cast<double>(std::max<size_t>(entries, 1));
+		double spread = std::max(2.0 + range_ratio * 4.0, tenure_years * 365.25 / count);
+		// Weekdays left per entry, less what a range adds on average
+		double room = (Date::from_ymd(BusinessCalendar::LAST_YEAR, 1, 1) - hired()) / count * 5.0 / 7.0;
+		double fit = room - range_ratio * 3.5;
+		return fit >= 1.0 ? std::min(spread, fit) : std::min(room, 0.99);
+	}
+};
+
+BusinessCalendar make_synthetic_calendar(int first_year, int last_year, int holidays_per_year, uint32_t seed) {
+	std::mt19937 rng(seed);
+	std::map<Date, std::string> holidays;
+	for (int year = first_year; year <= last_year; ++year) {
+		for (int placed = 0; placed < holidays_per_year;) {
+			Date day = Date::from_ymd(year, 1, 1) + static_cast<int>(rng() % 365);
+			if (is_weekday(day) && holidays.emplace(day, "Holiday").second) {
+				placed++;
+			}
+		}
+	}
+	return BusinessCalendar(HOLIDAY_RULE_SETS[1], std::move(holidays));
+}
+
+// Swallows output, for timing renderers without a terminal in the way
+class NullBuffer : public std::streambuf {
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+struct BenchResult {
+	double ns_per_op = 0.0;
+	double allocations_per_op = 0.0;
+};
+
+// Runs fn (which performs ops_per_call operations) until at least 50 ms have passed and
+// returns the mean time and heap allocations per operation
+template <typename Fn>
+BenchResult measure(size_t ops_per_call, Fn fn) {
+	using clock = std::chrono::steady_clock;
+	fn(); // warm up caches and lazily built tables
+	size_t calls = 0;
+	uint64_t allocations = thread_heap_allocations;
+	auto start = clock::now();
+	auto elapsed = clock::duration::zero();
+	do {
+		fn();
+		calls++;
+		elapsed = clock::now() - start;
+	} while (elapsed < std::chrono::milliseconds(50));
+	double ops = static_cast<double>(calls) * static_cast<double>(std::max<size_t>(ops_per_call, 1));
+	BenchResult result;
+	result.ns_per_op = std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+	result.allocations_per_op = static_cast<double>(thread_heap_allocations - allocations) / ops;
+	return result;
+}
+
+// Times the accrual, usage, lookup, load/save and rendering paths on synthetic ledgers of 10
+// entries up to max_entries, growing tenfold. An op is one call of the named function, except
+// where the unit column says it is per entry.
+void run_benchmarks(size_t max_entries, SyntheticLedgerSpec spec, OutputFormat format) {
+	volatile double sink = 0.0;
+	std::unique_ptr<RecordWriter> records;
+	std::unique_ptr<TableWriter> table;
+	if (format != OutputFormat::Table) {
+		records.reset(new RecordWriter(std::cout, format, { "benchmark", "entries", "ns_per_op", "allocations_per_op", "unit" }));
+	}
+	else {
+		std::cout << "Tenure " << spec.tenure_years << " years, range ratio " << spec.range_ratio
+			<< ", " << spec.holidays_per_year << " holidays per year\n";
+		table.reset(new TableWriter(std::cout, { 30, 9, 14, 18, 9 }));
+		table->row({ "Benchmark", "Entries", "ns/op", "Allocations/op", "Unit" });
+	}
+	auto report = [&](const char* name, size_t entries, const char* unit, BenchResult result) {
+		if (records) {
+			records->field(name).field(static_cast<int>(entries)).field(result.ns_per_op).field(result.allocations_per_op).field(unit);
+			records->end_record();
+			return;
+		}
+		char ns[32];
+		char allocations[32];
+		std::snprintf(ns, sizeof(ns), "%.1f", result.ns_per_op);
+		std::snprintf(allocations, sizeof(allocations), "%.2f", result.allocations_per_op);
+		table->row({ name, std::to_string(entries), ns, allocations, unit });
+		table->flush();
+	};
+
+	for (size_t entries = 10; entries <= max_entries; entries *= 10) {
+		spec.entries = entries;
+		Date hired = spec.hired();
+		LeaveStore store = make_synthetic_ledger(entries, spec.range_ratio, spec.seed, hired, spec.spacing());
+		Date last = store.empty() ? hired : store.last[store.size() - 1];
+		BusinessCalendar calendar = make_synthetic_calendar(hired.year(), last.year() + 1, spec.holidays_per_year, spec.seed);
+		DaysOffIndex index(store, calendar);
+
+		std::vector<std::string> dates;
+		for (size_t i = 0; i < store.size(); ++i) {
+			dates.push_back(store.first[i].to_string());
+		}
+		report("Date::parse", entries, "date", measure(dates.size(), [&] {
+			for (const std::string& date : dates) {
+				sink = sink + Date::parse(date).days;
+			}
+		}));
+
+		int span = std::max(1, last - hired);
+		report("calculate_accrued_hours", entries, "call", measure(1000, [&] {
+			for (int i = 0; i < 1000; ++i) {
+				sink = sink + calculate_accrued_hours(hired + (i * 7919) % span, 0.61538, calendar);
+			}
+		}));
+
+		AccrualPolicy policy;
+		policy.hired = hired;
+		policy.tiers = { { 0, 0.46 }, { 3, 0.61538 }, { 5, 0.77 } };
+		policy.cap_hours = 160.0;
+		report("AccrualPlan build (capped)", entries, "entry", measure(entries, [&] {
+			sink = sink + AccrualPlan(policy, index).pieces();
+		}));
+
+		AccrualPlan plan(policy, index);
+		report("AccrualPlan::accrued_on", entries, "call", measure(1000, [&] {
+			for (int i = 0; i < 1000; ++i) {
+				sink = sink + plan.accrued_on(hired + (i * 7919) % span);
+			}
+		}));
+
+		report("DaysOffIndex build", entries, "entry", measure(entries, [&] {
+			DaysOffIndex built(store, calendar);
+			sink = sink + built.size();
+		}));
+
+		report("calculate_hours_of_days_off", entries, "call", measure(1000, [&] {
+			for (int i = 0; i < 1000; ++i) {
+				sink = sink + calculate_hours_of_days_off(index);
+			}
+		}));
+
+		report("hours_used (window)", entries, "call", measure(1000, [&] {
+			for (int i = 0; i < 1000; ++i) {
+				Date from = hired + (i * 7919) % span;
+				sink = sink + index.hours_used(from, from + 90);
+			}
+		}));
+
+		report("is_day_off", entries, "lookup", measure(1000, [&] {
+			for (int i = 0; i < 1000; ++i) {
+				sink = sink + is_day_off(index, hired + (i * 7919) % span);
+			}
+		}));
+
+		std::string text = encode_document(store.to_json(), DocumentFormat::Json);
+		report("JSON load", entries, "entry", measure(entries, [&] {
+			sink = sink + LeaveStore::from_json(decode_document(text, DocumentFormat::Json)).size();
+		}));
+
+		report("JSON save", entries, "entry", measure(entries, [&] {
+			sink = sink + encode_document(store.to_json(), DocumentFormat::Json).size();
+		}));
+
+		NullBuffer null_buffer;
+		std::streambuf* saved = std::cout.rdbuf(&null_buffer);
+		BenchResult render = measure(entries, [&] {
+			list_days_off_tabulate(store, calendar);
+		});
+		std::cout.rdbuf(saved);
+		report("list_days_off_tabulate", entries, "entry", render);
+	}
+}
+
+// Weekdays in [first, last] the slow way, one day at a time, for checking count_weekdays
+int count_weekdays_by_day(Date first, Date last) {
+	int count = 0;
+	for (Date d = first; d <= last; ++d) {
+		count += is_weekday(d);
+	}
+	return count;
+}
+
+// Differential check of the closed-form weekday count against the day loop, on random ranges
+// plus ranges around the 1970 epoch, around leap days (1900 and 2100 are not leap years,
+// 2000 is) and with reversed bounds. Also walks the civil calendar day by day from 1900 to
+// 2200 to check the day numbers and weekdays under it. Returns the number of mismatches.
+int selftest_weekdays() {
+	int failures = 0;
+	auto check = [&](Date first, Date last) {
+		int expected = count_weekdays_by_day(first, last);
+		int got = count_weekdays(first, last);
+		// Only the first few mismatches are worth printing
+		if (got != expected && failures++ < 10) {
+			std::cerr << "Error: count_weekdays(" << first.to_string() << ", " << last.to_string() << ") is " << got
+				<< ", the day loop gives " << expected << "\n";
+		}
+	};
+
+	std::mt19937 rng(2025);
+	Date low = Date::from_ymd(1950, 1, 1);
+	Date high = Date::from_ymd(2120, 12, 31);
+	size_t ranges = 0;
+	for (int i = 0; i < 20000; ++i, ++ranges) {
+		Date first = low + static_cast<int>(rng() % static_cast<uint32_t>(high - low));
+		check(first, first + static_cast<int>(rng() % 4000) - 20);
+	}
+	const Date edges[] = {
+		Date::from_ymd(1970, 1, 1), Date::from_ymd(1900, 2, 28), Date::from_ymd(2000, 2, 29),
+		Date::from_ymd(2024, 2, 29), Date::from_ymd(2100, 2, 28), Date::from_ymd(2100, 3, 1),
+	};
+	for (Date edge : edges) {
+		for (int before = -12; before <= 12; ++before) {
+			for (int length = -3; length <= 30; ++length, ++ranges) {
+				check(edge + before, edge + before + length);
+			}
+		}
+	}
+
+	// Day numbers and weekdays against a calendar counted forward from Monday 1900-01-01
+	int y = 1900;
+	unsigned m = 1;
+	unsigned d = 1;
+	int weekday = 1;
+	for (Date day = Date::from_ymd(1900, 1, 1); day < Date::from_ymd(2200, 1, 1); ++day) {
+		CivilYmd civil = day.ymd();
+		if (civil.year != y || civil.month != m || civil.day != d || day.weekday() != weekday) {
+			std::cerr << "Error: day " << day.days << " is " << day.to_string() << " (weekday " << day.weekday()
+				<< "), counting gives " << y << "-" << m << "-" << d << " (weekday " << weekday << ")\n";
+			failures++;
+			break;
+		}
+		weekday = (weekday + 1) % 7;
+		if (++d > days_in_month(y, m)) {
+			d = 1;
+			if (++m > 12) {
+				m = 1;
+				y++;
+			}
+		}
+	}
+	std::cout << "count_weekdays: " << ranges << " ranges against the day loop, " << failures << " mismatches\n";
+	return failures;
+}
+
+// Hours credited and expired through each day from the start date to `last`, the slow way:
+// each business day earns its tier's rate, each credit moment credits what was earned but
+// never past the cap over what was charged on earlier days, and the day before each
+// anniversary (through the calendar's last year) expires the balance above the carryover
+struct AccrualByDay {
+	std::vector<double> accrued;
+	std::vector<double> expired; // at anniversaries on or before the day
+};
+
+AccrualByDay accrue_by_day(const AccrualPolicy& policy, const LeaveStore& store, const BusinessCalendar& calendar, Date last) {
+	size_t days = static_cast<size_t>(last - policy.hired) + 1;
+	std::vector<double> charged(days, 0.0);
+	double used = 0.0;
+	for (size_t i = 0; i < store.size(); ++i) {
+		for (Date d = store.first[i]; d <= store.last[i]; ++d) {
+			if (store.kind[i] == LeaveKind::SingleDay || calendar.is_business_day(d)) {
+				if (d < policy.hired) {
+					used += store.hours[i];
+				}
+				else if (d <= last) {
+					charged[static_cast<size_t>(d - policy.hired)] += store.hours[i];
+				}
+			}
+		}
+	}
+
+	AccrualByDay result;
+	double credited = 0.0;
+	double earned = 0.0;
+	double expired = 0.0;
+	int year = 1;
+	for (size_t i = 0; i < days; ++i) {
+		Date d = policy.hired + static_cast<int>(i);
+		double rate = 0.0;
+		for (const AccrualTier& tier : policy.tiers) {
+			if (add_years(policy.hired, tier.after_years) <= d) {
+				rate = tier.rate_per_day;
+			}
+		}
+		if (calendar.is_business_day(d)) {
+			earned += rate;
+		}
+		int period = policy.grant_every_days;
+		if (period == 0 || ((d - policy.grant_anchor) % period + period) % period == 0) {
+			credited = std::min(credited + earned, policy.cap_hours + used);
+			earned = 0.0;
+		}
+		result.accrued.push_back(credited);
+		result.expired.push_back(expired);
+		used += charged[i];
+		Date anniversary = add_years(policy.hired, year);
+		if (d + 1 == anniversary && policy.carries_over() && anniversary.year() <= BusinessCalendar::LAST_YEAR) {
+			double excess = std::max(0.0, credited - used - policy.carryover_hours);
+			used += excess;
+			expired += excess;
+			year++;
+		}
+	}
+	return result;
+}
+
+// Differential check of compiled accrual plans against the day-by-day walk, for random
+// policies (tiers including zero rates, caps, grants, carryover) over random ledgers, plus a
+// capped grant policy whose last tier stops accruing. Returns the number of mismatches.
+int selftest_plans() {
+	static const BusinessCalendar calendar(HOLIDAY_RULE_SETS[0]);
+	int failures = 0;
+	size_t days = 0;
+	auto check = [&](const AccrualPolicy& policy, const LeaveStore& store, Date last) {
+		DaysOffIndex index(store, calendar);
+		AccrualPlan plan(policy, index);
+		AccrualByDay expected = accrue_by_day(policy, store, calendar, last);
+		for (size_t i = 0; i < expected.accrued.size(); ++i, ++days) {
+			Date d = policy.hired + static_cast<int>(i);
+			double accrued = plan.accrued_on(d);
+			double expired = plan.expired_through(d);
+			if (std::abs(accrued - expected.accrued[i]) > 1e-6 * std::max(1.0, expected.accrued[i]) ||
+				std::abs(expired - expected.expired[i]) > 1e-6 * std::max(1.0, expected.expired[i])) {
+				// Only the first mismatch of a policy is worth printing
+				if (failures++ < 10) {
+					std::cerr << "Error: a plan hired " << policy.hired.to_string() << " accrues " << accrued << " and expires "
+						<< expired << " through " << d.to_string() << ", the day walk gives " << expected.accrued[i] << " and "
+						<< expected.expired[i] << "\n";
+				}
+				return;
+			}
+		}
+	};
+
+	AccrualPolicy stops;
+	stops.hired = stops.grant_anchor = Date::from_ymd(2007, 5, 17);
+	stops.tiers = { { 1, 0.3 }, { 4, 0.0 } };
+	stops.cap_hours = 40.0;
+	stops.grant_every_days = 9;
+	// Leave just before the last tier takes the balance off the cap as accrual stops
+	LeaveStore before_stop;
+	before_stop.add(Date::from_ymd(2011, 5, 2), Date::from_ymd(2011, 5, 2), 4.0, LeaveKind::SingleDay, "");
+	check(stops, before_stop, Date::from_ymd(2013, 1, 1));
+
+	std::mt19937 rng(2021);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	int policies = 1;
+	for (; policies < 300; ++policies) {
+		AccrualPolicy policy;
+		policy.hired = Date::from_ymd(1995, 1, 1) + static_cast<int>(rng() % 7300);
+		policy.grant_anchor = policy.hired + static_cast<int>(rng() % 61) - 30;
+		int after = static_cast<int>(rng() % 2);
+		for (int tiers = 1 + static_cast<int>(rng() % 3); tiers > 0; --tiers, after += 1 + static_cast<int>(rng() % 4)) {
+			// A third of the rates are zero
+			policy.tiers.push_back({ after, rng() % 3 == 0 ? 0.0 : 0.1 + unit(rng) });
+		}
+		if (rng() % 3 != 0) {
+			policy.cap_hours = 8.0 + unit(rng) * 200.0;
+		}
+		if (rng() % 2 == 0) {
+			policy.grant_every_days = 1 + static_cast<int>(rng() % 30);
+		}
+		if (rng() % 3 == 0) {
+			policy.carryover_hours = unit(rng) * 80.0;
+		}
+		Date last = policy.hired + 365 * (2 + static_cast<int>(rng() % 14));
+		size_t entries = rng() % 200;
+		double spacing = entries == 0 ? 3.0 : std::max(1.0, (last - policy.hired) / static_cast<double>(entries) / 2.0);
+		check(policy, make_synthetic_ledger(entries, 0.25, rng(), policy.hired - 60, spacing), last);
+	}
+	std::cout << "accrual plans: " << policies << " policies over " << days << " days against the day walk, " << failures << " mismatches\n";
+	return failures;
+}
+
+// Accrual and usage figures for a fixed made-up ledger as of a date, one per line, for
+// comparing runs under different time zones
+std::string date_math_figures(Date as_of) {
+	static const BusinessCalendar calendar(HOLIDAY_RULE_SETS[0]);
+	AccrualPolicy policy;
+	policy.hired = policy.grant_anchor = Date::from_ymd(2015, 3, 2);
+	policy.tiers = { { 0, 0.6 }, { 3, 0.8 } };
+	policy.cap_hours = 200.0;
+	policy.carryover_hours = 40.0;
+	LeaveStore store = make_synthetic_ledger(150, 0.25, 7, policy.hired, 25.0);
+	DaysOffIndex index(store, calendar);
+	AccrualPlan plan(policy, index);
+	BalanceTimeline timeline(plan, as_of + 60, index);
+
+	std::ostringstream out;
+	out << std::setprecision(17);
+	out << Date::parse(as_of.to_string()).days << " " << as_of.weekday() << " " << count_weekdays(as_of - 400, as_of) << "\n";
+	out << working_days_elapsed_since(policy.hired, calendar, as_of) << " " << calculate_accrued_hours(policy.hired, 0.61538, calendar, as_of) << "\n";
+	out << plan.accrued_on(as_of) << " " << plan.expired_through(as_of) << " " << plan.rate_on(as_of) << "\n";
+	out << calculate_hours_of_days_off(index) << " " << index.hours_used_through(as_of) << "\n";
+	for (int k = 0; k <= 60; k += 7) {
+		out << timeline.balance_on(as_of + k) << (k + 7 > 60 ? "\n" : " ");
+	}
+	return out.str();
+}
+
+void set_environment(const char* name, const std::string& value) {
+#ifdef _WIN32
+	_putenv_s(name, value.c_str());
+#else
+	setenv(name, value.c_str(), 1);
+#endif
+}
+
+void unset_environment(const char* name) {
+#ifdef _WIN32
+	_putenv_s(name, "");
+#else
+	unsetenv(name);
+#endif
+}
+
+// Sets a variable back to what std::getenv returned for it earlier, unsetting it if that was null
+void restore_environment(const char* name, const char* saved) {
+	if (saved) {
+		set_environment(name, saved);
+	}
+	else {
+		unset_environment(name);
+	}
+}
+
+// The local date under the current TZ, by strftime rather than the Date conversion today() uses
+std::string local_date_now() {
+	std::time_t now = std::time(nullptr);
+	char text[16];
+	std::strftime(text, sizeof(text), "%Y-%m-%d", std::localtime(&now));
+	return text;
+}
+
+// What "<self> selftest probe" prints, or an empty string if it cannot be run
+std::string run_selftest_probe_of(const std::string& self) {
+#ifdef _WIN32
+	FILE* pipe = _popen(("\"" + self + "\" selftest probe").c_str(), "r");
+#else
+	FILE* pipe = popen(("\"" + self + "\" selftest probe").c_str(), "r");
+#endif
+	std::string output;
+	if (pipe) {
+		char buffer[4096];
+		size_t got;
+		while ((got = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+			output.append(buffer, got);
+		}
+#ifdef _WIN32
+		_pclose(pipe);
+#else
+		pclose(pipe);
+#endif
+	}
+	return output;
+}
+
+// Runs this program as "<self> selftest probe" under every pairing of a TZ value and a
+// PTO_TODAY date (the days clocks change in the US, Europe and Lord Howe, and a leap day),
+// and checks that it reports the pinned date and the same figures as this process computes
+// for it. Then runs it once per TZ value without the pin and checks that today() is the local
+// date strftime gives for that zone (zones 28 hours apart make sure some of them differ).
+// Returns the number of mismatches.
+int selftest_time_zones(const std::string& self) {
+	const char* zones[] = {
+		"UTC", "America/New_York", "America/Los_Angeles", "Europe/London", "Australia/Lord_Howe",
+		"Pacific/Kiritimati", "Asia/Kolkata", "EST5EDT", "<-14>14",
+	};
+	const char* dates[] = {
+		"2024-02-29", "2024-03-10", "2024-03-31", "2024-04-07", "2024-10-06", "2024-10-27", "2024-11-03", "2025-01-01",
+	};
+	// Copies, since setting the variables may free what getenv returned
+	const char* zone_set = std::getenv("TZ");
+	const char* pin_set = std::getenv("PTO_TODAY");
+	std::string saved_zone = zone_set ? zone_set : "";
+	std::string saved_pin = pin_set ? pin_set : "";
+	int failures = 0;
+	int runs = 0;
+	for (const char* date : dates) {
+		std::string expected = std::string(date) + "\n" + date_math_figures(Date::parse(date));
+		for (const char* zone : zones) {
+			set_environment("TZ", zone);
+			set_environment("PTO_TODAY", date);
+			std::string output = run_selftest_probe_of(self);
+			runs++;
+			if (output != expected) {
+				std::cerr << "Error: with TZ=" << zone << " PTO_TODAY=" << date << " the figures differ:\n" << output
+					<< "expected:\n" << expected;
+				failures++;
+			}
+		}
+	}
+
+	unset_environment("PTO_TODAY");
+	std::vector<std::string> local_dates;
+	for (const char* zone : zones) {
+		set_environment("TZ", zone);
+		// A probe that straddles midnight may report either side of it
+		std::string before = local_date_now();
+		std::string output = run_selftest_probe_of(self);
+		std::string after = local_date_now();
+		runs++;
+		std::string reported = output.substr(0, output.find('\n'));
+		local_dates.push_back(before);
+		if ((reported != before && reported != after) ||
+			output != reported + "\n" + date_math_figures(Date::parse(reported))) {
+			std::cerr << "Error: with TZ=" << zone << " and no PTO_TODAY the probe gives:\n" << output
+				<< "expected today to be " << before << "\n";
+			failures++;
+		}
+	}
+	restore_environment("TZ", zone_set ? saved_zone.c_str() : nullptr);
+	restore_environment("PTO_TODAY", pin_set ? saved_pin.c_str() : nullptr);
+	std::sort(local_dates.begin(), local_dates.end());
+	local_dates.erase(std::unique(local_dates.begin(), local_dates.end()), local_dates.end());
+	std::cout << "time zones: " << runs << " runs over " << std::size(zones) << " TZ values (" << local_dates.size()
+		<< " local dates unpinned), " << failures << " mismatches\n";
+	return failures;
+}
+
+// What `pto selftest probe` prints: today (from the clock, or as pinned by PTO_TODAY) and the
+// figures as of it
+int run_selftest_probe() {
+	std::cout << today().to_string() << "\n" << date_math_figures(today());
+	return 0;
+}
+
+// Checks the date math against slow reference versions and across time zones; exits
+// non-zero on any mismatch. `self` is how to run this program again.
+int run_selftest(const std::string& self) {
+	int failures = selftest_weekdays();
+	failures += selftest_plans();
+	failures += selftest_time_zones(self);
+	std::cout << (failures == 0 ? "All self-tests passed.\n" : "Self-tests FAILED.\n");
+	return failures == 0 ? 0 : 1;
+}
+
+// Worker threads to use: PTO_THREADS if set, otherwise one per hardware thread
+unsigned worker_count() {
+	const char* configured = std::getenv("PTO_THREADS");
+	if (configured && std::atoi(configured) > 0) {
+		return static_cast<unsigned>(std::atoi(configured));
+	}
+	unsigned hw = std::thread::hardware_concurrency();
+	return hw == 0 ? 1 : hw;
+}
+
+// Runs fn(i) for every i in [0, count) across worker threads that pull the next index
+// from a shared counter, and returns once all of them are done
+template <typename Fn>
+void parallel_for(size_t count, Fn fn, unsigned threads = 0) {
+	if (threads == 0) {
+		threads = worker_count();
+	}
+	threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(count, 1)));
+	std::atomic<size_t> next(0);
+	auto work = [&] {
+		for (size_t i = next++; i < count; i = next++) {
+			fn(i);
+		}
+	};
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; ++t) {
+		pool.emplace_back(work);
+	}
+	work();
+	for (auto& thread : pool) {
+		thread.join();
+	}
+}
+
+const std::string LEDGER_SETTINGS_NAME = "settings.json";
+const std::string LEDGER_DAYS_OFF_NAME = "days_off.json";
+
+// Summary figures for one ledger directory. A .ptol ledger with no pending journal edits is
+// mapped and read in place instead of being decoded.
+PtoSummary summarize_ledger(const fs::path& dir, const HolidayCalendars& calendars) {
+	json settings = load_document(find_document((dir / LEDGER_SETTINGS_NAME).string()));
+	const BusinessCalendar& calendar = calendars.for_settings(settings);
+	std::string days_off_path = days_off_path_for((dir / LEDGER_DAYS_OFF_NAME).string(), settings);
+	AccrualPolicy policy = accrual_policy_for(settings);
+	// A cap or carryover needs the leave day by day, which the mapped image does not index
+	if (!policy.needs_usage() && is_ledger_image_path(days_off_path) && fs::exists(days_off_path) && !has_journaled_edits(days_off_path)) {
+		MappedLedger ledger(days_off_path);
+		return compute_pto_summary(AccrualPlan(policy, calendar), ledger.image().hours_used(calendar), calendar);
+	}
+	LeaveStore days_off = LedgerFile(days_off_path).load(false);
+	DaysOffIndex index(days_off, calendar);
+	if (policy.carries_over()) {
+		return compute_pto_summary(checkpointed_plan(policy, index, checkpoint_path_for(days_off_path), today(), false), calculate_hours_of_days_off(index), calendar);
+	}
+	return compute_pto_summary(AccrualPlan(policy, index), calculate_hours_of_days_off(index), calendar);
+}
+
+// Ledger directories named by a batch argument: every subdirectory of a directory that has a
+// settings.json, or one path per line of a manifest file (relative to the manifest, # comments)
+std::vector<fs::path> find_ledger_dirs(const std::string& source) {
+	std::vector<fs::path> dirs;
+	fs::path root(source);
+	if (fs::is_directory(root)) {
+		for (const auto& item : fs::directory_iterator(root)) {
+			if (item.is_directory() && fs::exists(find_document((item.path() / LEDGER_SETTINGS_NAME).string()))) {
+				dirs.push_back(item.path());
+			}
+		}
+		std::sort(dirs.begin(), dirs.end());
+		return dirs;
+	}
+	std::ifstream manifest(root);
+	if (!manifest) {
+		throw std::runtime_error("Cannot open ledger directory or manifest " + source + ".");
+	}
+	std::string line;
+	while (std::getline(manifest, line)) {
+		line.erase(0, line.find_first_not_of(" \t\r"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		fs::path dir(line);
+		dirs.push_back(dir.is_absolute() ? dir : root.parent_path() / dir);
+	}
+	return dirs;
+}
+
+// Compute the PTO summary for every ledger on a worker pool, printing one line per employee
+// in input order as soon as it and everything before it are done
+int run_batch(const std::string& source, OutputFormat format = OutputFormat::Table) {
+	std::vector<fs::path> dirs = find_ledger_dirs(source);
+	HolidayCalendars calendars(load_holiday_dates(HOLIDAYS_FILE));
+
+	struct Slot {
+		bool done = false;
+		bool ok = false;
+		PtoSummary summary;
+		std::string error;
+	};
+	std::vector<Slot> slots(dirs.size());
+	std::mutex mutex;
+	std::condition_variable ready;
+
+	std::thread producer([&] {
+		parallel_for(dirs.size(), [&](size_t i) {
+			Slot slot;
+			try {
+				slot.summary = summarize_ledger(dirs[i], calendars);
+				slot.ok = true;
+			}
+			catch (const std::exception& e) {
+				slot.error = e.what();
+			}
+			slot.done = true;
+			std::lock_guard<std::mutex> lock(mutex);
+			slots[i] = std::move(slot);
+			ready.notify_all();
+		});
+	});
+
+	std::unique_ptr<RecordWriter> records;
+	if (format != OutputFormat::Table) {
+		records.reset(new RecordWriter(std::cout, format, { "employee", "working_days", "accrued", "used", "expired", "balance" }));
+	}
+	else {
+		std::cout << std::left << std::setw(24) << "Employee"
+			<< std::right << std::setw(14) << "Working Days"
+			<< std::right << std::setw(12) << "Accrued"
+			<< std::right << std::setw(12) << "Used"
+			<< std::right << std::setw(12) << "Expired"
+			<< std::right << std::setw(12) << "Balance" << "\n";
+	}
+	int failures = 0;
+	for (size_t i = 0; i < dirs.size(); ++i) {
+		Slot slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [&] { return slots[i].done; });
+			slot = std::move(slots[i]);
+		}
+		ScopedPhase phase(Phase::Render);
+		std::string id = dirs[i].filename().string();
+		if (!slot.ok) {
+			std::cerr << "Error: " << id << ": " << slot.error << "\n";
+			failures++;
+			continue;
+		}
+		if (records) {
+			records->field(id).field(slot.summary.working_days).field(slot.summary.accrued)
+				.field(slot.summary.used).field(slot.summary.expired).field(slot.summary.balance);
+			records->end_record();
+			continue;
+		}
+		std::cout << std::left << std::setw(24) << id
+			<< std::right << std::setw(14) << slot.summary.working_days
+			<< std::right << std::setw(12) << slot.summary.accrued
+			<< std::right << std::setw(12) << slot.summary.used
+			<< std::right << std::setw(12) << slot.summary.expired
+			<< std::right << std::setw(12) << slot.summary.balance << "\n";
+	}
+	producer.join();
+	if (records) {
+		records->finish();
+	}
+	return failures == 0 ? 0 : 1;
+}
+
+// The days a vacation search may book: the working days (business days not already off) of
+// a window, how many days off already adjoin each one, and how many PTO days the projected
+// balance can cover through each
+struct VacationDays {
+	std::vector<Date> working;
+	std::vector<int> off_before; // consecutive days off just before, counted from the window start
+	std::vector<int> off_after;  // and just after, counted up to a month past the window
+	std::vector<int> allowance;  // PTO days booked through here that keep every later balance >= 0
+};
+
+VacationDays vacation_days(const DaysOffIndex& index, const AccrualPlan& plan, Date from, Date to, double hours_per_day) {
+	const BusinessCalendar& calendar = index.calendar();
+	auto off = [&](Date d) { return !calendar.is_business_day(d) || index.contains(d); };
+	// Leave already booked past the window still has to be paid for
+	Date horizon = to;
+	if (index.size() > 0) {
+		horizon = std::max(horizon, index.last_covered());
+	}
+	BalanceTimeline timeline(plan, horizon, index);
+
+	VacationDays days;
+	for (Date d = from; d <= to; ++d) {
+		if (!off(d)) {
+			days.working.push_back(d);
+		}
+	}
+	int run = 0;
+	size_t next = 0;
+	for (Date d = from; d <= to; ++d) {
+		if (next < days.working.size() && days.working[next] == d) {
+			days.off_before.push_back(run);
+			next++;
+			run = 0;
+		}
+		else {
+			run++;
+		}
+	}
+	for (Date d : days.working) {
+		int after = 0;
+		while (after < 31 && off(d + 1 + after)) {
+			after++;
+		}
+		days.off_after.push_back(after);
+	}
+	// The tightest balance from each working day on bounds what can be booked through it
+	double lowest = std::numeric_limits<double>::infinity();
+	days.allowance.resize(days.working.size());
+	size_t w = days.working.size();
+	for (Date d = horizon; d >= from; d = d - 1) {
+		lowest = std::min(lowest, timeline.balance_on(d));
+		if (w > 0 && days.working[w - 1] == d) {
+			days.allowance[--w] = static_cast<int>(std::floor(lowest / hours_per_day + 1e-9));
+		}
+	}
+	return days;
+}
+
+// One stretch of consecutive days off that a plan books PTO in
+struct VacationBreak {
+	Date first;
+	Date last;
+	Date pto_first;
+	Date pto_last;
+	int pto_days = 0;
+};
+
+struct VacationPlan {
+	int days_off = 0; // calendar days in the plan's breaks
+	int pto_days = 0;
+	std::vector<VacationBreak> breaks;
+};
+
+// The top_k plans of at most `budget` PTO days with the most days off in breaks that contain
+// PTO (ties go to fewer PTO days), using at most max_breaks breaks (0: any number). A break
+// books a run of consecutive working days, so it is scored by the working days at its ends:
+// a k-best dynamic program over working-day positions p, PTO days c and breaks j keeps the
+// best plans for the working days before p with day p - 1 left unbooked. Layers are filled in
+// order of c; within a layer each position only reads finished layers, so positions are split
+// across threads for budgets over 10 days. A break is cut short as soon as its first day
+// would overdraw the projected balance, which prunes every longer break ending there too.
+std::vector<VacationPlan> optimize_vacation(const VacationDays& days, int budget, size_t top_k, int max_breaks) {
+	struct Entry {
+		int score;
+		int start;  // first working day of the break that led here, or -1 for an unbooked day
+		int rank;   // rank of the plan extended, in its own state
+	};
+	const int m = static_cast<int>(days.working.size());
+	const int budgets = budget + 1;
+	const int breaks = max_breaks > 0 ? max_breaks + 1 : 1;
+	auto at = [&](int p, int c, int j) { return (static_cast<size_t>(p) * budgets + c) * breaks + j; };
+	std::vector<std::vector<Entry>> states(static_cast<size_t>(m + 2) * budgets * breaks);
+	auto better = [](const Entry& a, const Entry& b) {
+		return std::make_tuple(-a.score, a.start, a.rank) < std::make_tuple(-b.score, b.start, b.rank);
+	};
+	auto keep_best = [&](std::vector<Entry>& entries) {
+		std::sort(entries.begin(), entries.end(), better);
+		if (entries.size() > top_k) {
+			entries.resize(top_k);
+		}
+	};
+	auto span = [&](int t, int u) {
+		return (days.working[u] - days.working[t] + 1) + days.off_before[t] + days.off_after[u];
+	};
+
+	states[at(0, 0, 0)].push_back({ 0, -1, 0 });
+	std::vector<std::vector<Entry>> taken(static_cast<size_t>(m + 2) * breaks);
+	for (int c = 0; c <= budget; ++c) {
+		// Plans whose last break ends at working day p - 2, with p - 1 left unbooked
+		parallel_for(static_cast<size_t>(m + 1), [&](size_t slot) {
+			int p = static_cast<int>(slot) + 1;
+			for (int j = 0; j < breaks; ++j) {
+				taken[static_cast<size_t>(p) * breaks + j].clear();
+			}
+			int u = p - 2;
+			if (c == 0 || u < 0) {
+				return;
+			}
+			for (int t = u; t >= 0 && u - t + 1 <= c; --t) {
+				// Booking t..u after c - (u - t + 1) earlier days puts c - (u - t) days on or before t
+				if (c - (u - t) > days.allowance[t]) {
+					break;
+				}
+				int before = c - (u - t + 1);
+				for (int j = (max_breaks > 0 ? 1 : 0); j < breaks; ++j) {
+					const std::vector<Entry>& from = states[at(t, before, max_breaks > 0 ? j - 1 : 0)];
+					std::vector<Entry>& into = taken[static_cast<size_t>(p) * breaks + j];
+					for (size_t r = 0; r < from.size(); ++r) {
+						into.push_back({ from[r].score + span(t, u), t, static_cast<int>(r) });
+					}
+					keep_best(into);
+				}
+			}
+		}, budget > 10 ? 0 : 1);
+		for (int p = 1; p <= m + 1; ++p) {
+			for (int j = 0; j < breaks; ++j) {
+				std::vector<Entry>& state = states[at(p, c, j)];
+				const std::vector<Entry>& skipped = states[at(p - 1, c, j)];
+				for (size_t r = 0; r < skipped.size(); ++r) {
+					state.push_back({ skipped[r].score, -1, static_cast<int>(r) });
+				}
+				const std::vector<Entry>& booked = taken[static_cast<size_t>(p) * breaks + j];
+				state.insert(state.end(), booked.begin(), booked.end());
+				keep_best(state);
+			}
+		}
+	}
+
+	struct Final {
+		int score;
+		int c;
+		int j;
+		int rank;
+	};
+	std::vector<Final> finals;
+	for (int c = 1; c <= budget; ++c) {
+		for (int j = 0; j < breaks; ++j) {
+			const std::vector<Entry>& state = states[at(m + 1, c, j)];
+			for (size_t r = 0; r < state.size(); ++r) {
+				finals.push_back({ state[r].score, c, j, static_cast<int>(r) });
+			}
+		}
+	}
+	std::sort(finals.begin(), finals.end(), [](const Final& a, const Final& b) {
+		return std::make_tuple(-a.score, a.c, a.j, a.rank) < std::make_tuple(-b.score, b.c, b.j, b.rank);
+	});
+	if (finals.size() > top_k) {
+		finals.resize(top_k);
+	}
+
+	std::vector<VacationPlan> plans;
+	for (const Final& final : finals) {
+		VacationPlan plan;
+		plan.days_off = final.score;
+		plan.pto_days = final.c;
+		int p = m + 1;
+		int c = final.c;
+		int j = final.j;
+		int rank = final.rank;
+		while (p > 0) {
+			const Entry& entry = states[at(p, c, j)][static_cast<size_t>(rank)];
+			if (entry.start < 0) {
+				p--;
+			}
+			else {
+				int t = entry.start;
+				int u = p - 2;
+				VacationBreak stretch;
+				stretch.first = days.working[t] - days.off_before[t];
+				stretch.last = days.working[u] + days.off_after[u];
+				stretch.pto_first = days.working[t];
+				stretch.pto_last = days.working[u];
+				stretch.pto_days = u - t + 1;
+				plan.breaks.push_back(stretch);
+				c -= stretch.pto_days;
+				j -= max_breaks > 0 ? 1 : 0;
+				p = t;
+			}
+			rank = entry.rank;
+		}
+		std::reverse(plan.breaks.begin(), plan.breaks.end());
+		plans.push_back(std::move(plan));
+	}
+	return plans;
+}
+
+// The month and day some months later, clamped to the end of a shorter month
+Date add_months(Date date, int months) {
+	CivilYmd c = date.ymd();
+	int index = c.year * 12 + static_cast<int>(c.month) - 1 + months;
+	int year = index / 12;
+	unsigned month = static_cast<unsigned>(index % 12) + 1;
+	return Date::from_ymd(year, month, std::min(c.day, days_in_month(year, month)));
+}
+
+// CLI: where to book `budget` PTO days over the coming months for the longest breaks
+void print_vacation_plans(const json& settings, const DaysOffIndex& index, int budget, int months, size_t top_k, int max_breaks,
+	OutputFormat format = OutputFormat::Table) {
+	const double hours_per_day = 8.0;
+	Date from = today() + 1;
+	Date to = add_months(today(), months);
+	std::vector<VacationPlan> plans;
+	{
+		ScopedPhase phase(Phase::Compute);
+		AccrualPlan plan(accrual_policy_for(settings), index);
+		plans = optimize_vacation(vacation_days(index, plan, from, to, hours_per_day), budget, top_k, max_breaks);
+	}
+
+	ScopedPhase phase(Phase::Render);
+	if (format != OutputFormat::Table) {
+		RecordWriter records(std::cout, format, { "plan", "days_off", "pto_days", "break_start", "break_end", "break_days",
+			"pto_start", "pto_end", "break_pto_days" });
+		for (size_t i = 0; i < plans.size(); ++i) {
+			for (const VacationBreak& stretch : plans[i].breaks) {
+				records.field(static_cast<int>(i + 1)).field(plans[i].days_off).field(plans[i].pto_days)
+					.field(stretch.first.to_string()).field(stretch.last.to_string()).field(stretch.last - stretch.first + 1)
+					.field(stretch.pto_first.to_string()).field(stretch.pto_last.to_string()).field(stretch.pto_days);
+				records.end_record();
+			}
+		}
+		return;
+	}
+	if (plans.empty()) {
+		std::cout << "No PTO day between " << from.to_string() << " and " << to.to_string() << " fits the projected balance.\n";
+		return;
+	}
+	std::cout << "Best placements of up to " << budget << " PTO days between " << from.to_string() << " and " << to.to_string() << "\n";
+	std::vector<std::vector<std::string>> rows;
+	rows.push_back({ "Plan", "Days Off", "PTO Days", "Break", "Length", "PTO Booked" });
+	for (size_t i = 0; i < plans.size(); ++i) {
+		for (size_t b = 0; b < plans[i].breaks.size(); ++b) {
+			const VacationBreak& stretch = plans[i].breaks[b];
+			std::string booked = stretch.pto_first.to_string();
+			if (stretch.pto_last != stretch.pto_first) {
+				booked += " to " + stretch.pto_last.to_string();
+			}
+			booked += " (" + std::to_string(stretch.pto_days) + (stretch.pto_days == 1 ? " day)" : " days)");
+			rows.push_back({ b == 0 ? std::to_string(i + 1) : "", b == 0 ? std::to_string(plans[i].days_off) : "",
+				b == 0 ? std::to_string(plans[i].pto_days) : "", stretch.first.to_string() + " to " + stretch.last.to_string(),
+				std::to_string(stretch.last - stretch.first + 1) + " days", booked });
+		}
+	}
+	write_table(std::cout, rows);
+}
+
+// Adds values up along a fixed pairwise tree. The grouping depends only on how many values
+// there are, so the result is bit-identical however many threads produced them.
+template <typename T>
+T tree_sum(const T* values, size_t count) {
+	if (count == 0) {
+		return T();
+	}
+	if (count == 1) {
+		return values[0];
+	}
+	size_t half = count / 2;
+	return tree_sum(values, half) + tree_sum(values + half, count - half);
+}
+
+// tree_sum with the leaves summed in fixed-size blocks across worker threads; the block
+// boundaries, like the tree, depend only on the count
+template <typename T>
+T parallel_tree_sum(const std::vector<T>& values) {
+	const size_t BLOCK = 4096;
+	std::vector<T> partial((values.size() + BLOCK - 1) / BLOCK);
+	parallel_for(partial.size(), [&](size_t b) {
+		size_t first = b * BLOCK;
+		partial[b] = tree_sum(values.data() + first, std::min(BLOCK, values.size() - first));
+	});
+	return tree_sum(partial.data(), partial.size());
+}
+
+// Unused PTO for some set of employees, valued at each one's hourly rate. Overdrawn balances
+// count toward the hours but not the liability.
+struct LiabilityTotals {
+	int employees = 0;
+	double balance_hours = 0.0;
+	double liability = 0.0;
+
+	LiabilityTotals operator+(const LiabilityTotals& other) const {
+		LiabilityTotals sum;
+		sum.employees = employees + other.employees;
+		sum.balance_hours = balance_hours + other.balance_hours;
+		sum.liability = liability + other.liability;
+		return sum;
+	}
+};
+
+struct EmployeeLiability {
+	std::string department;
+	std::string cost_center;
+	LiabilityTotals totals;
+};
+
+// One ledger directory's balance as of a date (accrued through it minus leave charged through
+// it) and its cost at the "hourly_rate" setting. Leave booked after the date is still owed,
+// so unlike the summary's and batch's balance, which deduct every entry, it is left out.
+// Throws if the rate or the ledger is missing.
+EmployeeLiability employee_liability(const fs::path& dir, const HolidayCalendars& calendars, Date as_of) {
+	json settings = load_document(find_document((dir / LEDGER_SETTINGS_NAME).string()));
+	if (!settings.contains("hourly_rate")) {
+		throw std::runtime_error("settings has no hourly_rate.");
+	}
+	const BusinessCalendar& calendar = calendars.for_settings(settings);
+	std::string days_off_path = days_off_path_for((dir / LEDGER_DAYS_OFF_NAME).string(), settings);
+	AccrualPolicy policy = accrual_policy_for(settings);
+	double accrued;
+	double used;
+	double expired = 0.0;
+	if (!policy.needs_usage() && is_ledger_image_path(days_off_path) && fs::exists(days_off_path) && !has_journaled_edits(days_off_path)) {
+		accrued = AccrualPlan(policy, calendar).accrued_on(as_of);
+		used = MappedLedger(days_off_path).image().hours_used(calendar, as_of);
+	}
+	else {
+		LeaveStore days_off = LedgerFile(days_off_path).load(false);
+		DaysOffIndex index(days_off, calendar);
+		AccrualPlan plan(policy, index);
+		accrued = plan.accrued_on(as_of);
+		used = index.hours_used_through(as_of);
+		expired = plan.expired_through(as_of);
+	}
+
+	EmployeeLiability employee;
+	employee.department = settings.value("department", "(none)");
+	employee.cost_center = settings.value("cost_center", "(none)");
+	employee.totals.employees = 1;
+	employee.totals.balance_hours = accrued - used - expired;
+	employee.totals.liability = std::max(0.0, employee.totals.balance_hours) * settings["hourly_rate"].get<double>();
+	return employee;
+}
+
+// Unused-PTO liability as of a date for every ledger of a directory or manifest, by
+// department and cost center, with department subtotals and an overall total. Employees are
+// computed in parallel; every total is a tree_sum over the employees in input order.
+int run_liability_report(const std::string& source, Date as_of, OutputFormat format) {
+	std::vector<fs::path> dirs = find_ledger_dirs(source);
+	HolidayCalendars calendars(load_holiday_dates(HOLIDAYS_FILE));
+	std::vector<EmployeeLiability> employees(dirs.size());
+	std::vector<std::string> errors(dirs.size());
+	parallel_for(dirs.size(), [&](size_t i) {
+		try {
+			employees[i] = employee_liability(dirs[i], calendars, as_of);
+		}
+		catch (const std::exception& e) {
+			errors[i] = e.what();
+		}
+	});
+
+	int failures = 0;
+	std::map<std::pair<std::string, std::string>, std::vector<LiabilityTotals>> by_cost_center;
+	std::map<std::string, std::vector<LiabilityTotals>> by_department;
+	std::vector<LiabilityTotals> everyone;
+	everyone.reserve(dirs.size());
+	for (size_t i = 0; i < dirs.size(); ++i) {
+		if (!errors[i].empty()) {
+			std::cerr << "Error: " << dirs[i].filename().string() << ": " << errors[i] << "\n";
+			failures++;
+			continue;
+		}
+		const EmployeeLiability& employee = employees[i];
+		by_cost_center[{ employee.department, employee.cost_center }].push_back(employee.totals);
+		by_department[employee.department].push_back(employee.totals);
+		everyone.push_back(employee.totals);
+	}
+
+	ScopedPhase phase(Phase::Render);
+	std::vector<std::vector<std::string>> rows;
+	std::unique_ptr<RecordWriter> records;
+	if (format != OutputFormat::Table) {
+		records.reset(new RecordWriter(std::cout, format, { "as_of", "department", "cost_center", "employees", "balance_hours", "liability" }));
+	}
+	else {
+		std::cout << "Unused PTO liability as of " << as_of.to_string() << "\n";
+		rows.push_back({ "Department", "Cost Center", "Employees", "Balance", "Liability" });
+	}
+	auto row = [&](const std::string& department, const std::string& cost_center, const LiabilityTotals& totals) {
+		if (records) {
+			records->field(as_of.to_string()).field(department).field(cost_center).field(totals.employees)
+				.field(totals.balance_hours).field(totals.liability);
+			records->end_record();
+			return;
+		}
+		char hours[32];
+		char money[32];
+		std::snprintf(hours, sizeof(hours), "%.1f hrs", totals.balance_hours);
+		std::snprintf(money, sizeof(money), "%.2f", totals.liability);
+		rows.push_back({ department, cost_center, std::to_string(totals.employees), hours, money });
+	};
+	for (const auto& department : by_department) {
+		for (auto group = by_cost_center.lower_bound({ department.first, std::string() });
+			group != by_cost_center.end() && group->first.first == department.first; ++group) {
+			row(department.first, group->first.second, tree_sum(group->second.data(), group->second.size()));
+		}
+		row(department.first, "(all)", tree_sum(department.second.data(), department.second.size()));
+	}
+	row("(all)", "(all)", parallel_tree_sum(everyone));
+	if (!records) {
+		write_table(std::cout, rows);
+	}
+	return failures == 0 ? 0 : 1;
+}
+
+// Leave habits fitted from the past year of a ledger: a two-state chain over business days
+// that starts a spell of leave with probability start, keeps it going with probability
+// keep, and charges hours_per_day for each day of it
+struct UsageModel {
+	double start = 0.0;
+	double keep = 0.0;
+	double hours_per_day = 8.0;
+	double days_per_year = 0.0;
+};
+
+UsageModel fit_usage(const DaysOffIndex& index, Date hired, Date as_of) {
+	const BusinessCalendar& calendar = index.calendar();
+	Date from = std::max(hired, add_years(as_of, -1) + 1);
+	int business_days = calendar.count_business_days(from, as_of);
+	UsageModel model;
+	int spells = 0;
+	int leave_days = 0;
+	double hours = 0.0;
+	for (size_t i : index.overlapping(from, as_of)) {
+		const LeaveSpan& span = index[i];
+		int days = span.single_day ? 1 : calendar.count_business_days(std::max(span.first, from), std::min(span.last, as_of));
+		if (days > 0) {
+			spells++;
+			leave_days += days;
+			hours += span.hours_between(from, as_of, calendar);
+		}
+	}
+	if (spells == 0 || business_days <= leave_days) {
+		return model;
+	}
+	model.start = static_cast<double>(spells) / (business_days - leave_days);
+	model.keep = 1.0 - static_cast<double>(spells) / leave_days;
+	model.hours_per_day = hours / leave_days;
+	model.days_per_year = leave_days * 261.0 / business_days;
+	return model;
+}
+
+// SplitMix64's output function: a well-mixed 64-bit value from a counter
+inline uint64_t mix64(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+const uint64_t MIX_GAMMA = 0x9E3779B97F4A7C15ull;
+
+// Balances on `target` along `trajectories` simulated futures of one ledger, from its
+// balance today. Each day follows the accrual plan's rules: expiry on anniversaries, then the
+// day's accrual credited up to the cap, then booked leave and, on open business days, leave
+// drawn from the usage model. Trajectories are stepped together one day at a time over
+// struct-of-arrays state. Trajectory t draws from its own SplitMix64 stream keyed by (seed,
+// stream, t), so results do not depend on how work is split across threads.
+std::vector<double> simulate_balances(const AccrualPolicy& policy, const AccrualPlan& plan, const DaysOffIndex& index,
+	const UsageModel& usage, Date target, size_t trajectories, uint64_t seed, uint64_t stream) {
+	const BusinessCalendar& calendar = index.calendar();
+	Date now = today();
+	double opening = plan.accrued_on(now) - index.hours_used_through(now) - plan.expired_through(now);
+	std::vector<double> balance(trajectories, opening);
+	if (target <= now) {
+		std::fill(balance.begin(), balance.end(), plan.accrued_on(target) - index.hours_used_through(target) - plan.expired_through(target));
+		return balance;
+	}
+	std::vector<uint64_t> state(trajectories);
+	std::vector<uint8_t> on_leave(trajectories, 0);
+	uint64_t key = mix64(seed ^ mix64(stream + MIX_GAMMA));
+	for (size_t t = 0; t < trajectories; ++t) {
+		state[t] = mix64(key + t * MIX_GAMMA);
+	}
+	// Accrual earned since the last credit and not yet credited
+	double pending = 0.0;
+	for (Date d = now; !plan.credits_on(d); d = d - 1) {
+		pending += calendar.is_business_day(d) ? plan.rate_on(d) : 0.0;
+	}
+	std::map<Date, double> booked;
+	for (const auto& charge : daily_charges(index, now + 1)) {
+		if (charge.first > target) {
+			break;
+		}
+		booked.insert(charge);
+	}
+	const double unit = 1.0 / 9007199254740992.0; // 2^-53
+	int year = 1;
+	while (add_years(policy.hired, year) <= now) {
+		year++;
+	}
+	for (Date d = now + 1; d <= target; ++d) {
+		if (policy.carries_over() && d == add_years(policy.hired, year)) {
+			year++;
+			for (size_t t = 0; t < trajectories; ++t) {
+				balance[t] = std::min(balance[t], policy.carryover_hours);
+			}
+		}
+		bool business = calendar.is_business_day(d);
+		if (business) {
+			pending += plan.rate_on(d);
+		}
+		if (plan.credits_on(d)) {
+			if (policy.capped()) {
+				for (size_t t = 0; t < trajectories; ++t) {
+					balance[t] += std::min(pending, std::max(0.0, policy.cap_hours - balance[t]));
+				}
+			}
+			else {
+				for (size_t t = 0; t < trajectories; ++t) {
+					balance[t] += pending;
+				}
+			}
+			pending = 0.0;
+		}
+		auto charge = booked.find(d);
+		if (charge != booked.end()) {
+			for (size_t t = 0; t < trajectories; ++t) {
+				balance[t] -= charge->second;
+			}
+		}
+		else if (business && usage.start > 0.0) {
+			for (size_t t = 0; t < trajectories; ++t) {
+				state[t] += MIX_GAMMA;
+				double u = static_cast<double>(mix64(state[t]) >> 11) * unit;
+				uint8_t off = u < (on_leave[t] ? usage.keep : usage.start);
+				on_leave[t] = off;
+				balance[t] -= off * usage.hours_per_day;
+			}
+		}
+	}
+	return balance;
+}
+
+// The q-quantile of samples, interpolating between order statistics; reorders samples
+double quantile(std::vector<double>& samples, double q) {
+	double position = q * static_cast<double>(samples.size() - 1);
+	size_t lower = static_cast<size_t>(position);
+	std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(lower), samples.end());
+	double value = samples[lower];
+	if (lower + 1 < samples.size()) {
+		double next = *std::min_element(samples.begin() + static_cast<std::ptrdiff_t>(lower) + 1, samples.end());
+		value += (position - static_cast<double>(lower)) * (next - value);
+	}
+	return value;
+}
+
+// Monte Carlo forecast of balances on a date for every ledger of a directory or manifest
+// (optionally one department): per employee and summed per department and overall, as
+// P10/P50/P90 over the trajectories. Department totals add up trajectory t of each member,
+// accumulated in integer micro-hours so the sums do not depend on thread scheduling.
+int run_forecast(const std::string& source, Date target, size_t trajectories, uint64_t seed, const std::string& department,
+	OutputFormat format) {
+	std::vector<fs::path> dirs = find_ledger_dirs(source);
+	HolidayCalendars calendars(load_holiday_dates(HOLIDAYS_FILE));
+	struct Forecast {
+		bool included = false;
+		std::string department;
+		double days_per_year = 0.0;
+		double p10 = 0.0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+	};
+	std::vector<Forecast> forecasts(dirs.size());
+	std::vector<std::string> errors(dirs.size());
+	std::map<std::string, size_t> group_of;
+	std::mutex groups_mutex;
+	std::vector<std::unique_ptr<std::vector<std::atomic<int64_t>>>> totals;
+	auto group_totals = [&](const std::string& name) -> std::vector<std::atomic<int64_t>>& {
+		std::lock_guard<std::mutex> lock(groups_mutex);
+		auto found = group_of.find(name);
+		if (found == group_of.end()) {
+			found = group_of.emplace(name, totals.size()).first;
+			totals.emplace_back(new std::vector<std::atomic<int64_t>>(trajectories));
+		}
+		return *totals[found->second];
+	};
+	// Kept apart from the departments, so one named "(all)" does not merge into it
+	std::vector<std::atomic<int64_t>> everyone(trajectories);
+
+	parallel_for(dirs.size(), [&](size_t i) {
+		try {
+			json settings = load_document(find_document((dirs[i] / LEDGER_SETTINGS_NAME).string()));
+			Forecast& forecast = forecasts[i];
+			forecast.department = settings.value("department", "(none)");
+			if (!department.empty() && forecast.department != department) {
+				return;
+			}
+			const BusinessCalendar& calendar = calendars.for_settings(settings);
+			LeaveStore days_off = LedgerFile(days_off_path_for((dirs[i] / LEDGER_DAYS_OFF_NAME).string(), settings)).load(false);
+			DaysOffIndex index(days_off, calendar);
+			AccrualPolicy policy = accrual_policy_for(settings);
+			AccrualPlan plan(policy, index);
+			UsageModel usage = fit_usage(index, policy.hired, today());
+			std::string id = dirs[i].filename().string();
+			std::vector<double> balances;
+			{
+				ScopedPhase phase(Phase::Compute);
+				balances = simulate_balances(policy, plan, index, usage, target, trajectories, seed, crc32(id));
+			}
+			std::vector<std::atomic<int64_t>>& group = group_totals(forecast.department);
+			for (size_t t = 0; t < trajectories; ++t) {
+				int64_t micro = static_cast<int64_t>(std::llround(balances[t] * 1e6));
+				group[t].fetch_add(micro, std::memory_order_relaxed);
+				everyone[t].fetch_add(micro, std::memory_order_relaxed);
+			}
+			forecast.days_per_year = usage.days_per_year;
+			forecast.p10 = quantile(balances, 0.1);
+			forecast.p50 = quantile(balances, 0.5);
+			forecast.p90 = quantile(balances, 0.9);
+			forecast.included = true;
+		}
+		catch (const std::exception& e) {
+			errors[i] = e.what();
+		}
+	});
+
+	ScopedPhase phase(Phase::Render);
+	std::vector<std::vector<std::string>> rows;
+	std::unique_ptr<RecordWriter> records;
+	if (format != OutputFormat::Table) {
+		records.reset(new RecordWriter(std::cout, format, { "date", "employee", "department", "leave_days_per_year", "p10", "p50", "p90" }));
+	}
+	else {
+		std::cout << "Forecast balances on " << target.to_string() << " over " << trajectories << " trajectories (seed " << seed << ")\n";
+		rows.push_back({ "Employee", "Department", "Leave/Year", "P10", "P50", "P90" });
+	}
+	// The overall row has no group: a null department in records, so no department name can
+	// stand for it
+	auto row = [&](const std::string& employee, const std::string* group, const std::string& leave, double p10, double p50, double p90) {
+		if (records) {
+			records->field(target.to_string()).field(employee);
+			if (group) {
+				records->field(*group);
+			}
+			else {
+				records->null();
+			}
+			if (leave.empty()) {
+				records->null();
+			}
+			else {
+				records->field(std::atof(leave.c_str()));
+			}
+			records->field(p10).field(p50).field(p90);
+			records->end_record();
+			return;
+		}
+		rows.push_back({ employee, group ? *group : "(all departments)", leave, format_hrs(p10), format_hrs(p50), format_hrs(p90) });
+	};
+	int failures = 0;
+	for (size_t i = 0; i < dirs.size(); ++i) {
+		if (!errors[i].empty()) {
+			std::cerr << "Error: " << dirs[i].filename().string() << ": " << errors[i] << "\n";
+			failures++;
+			continue;
+		}
+		const Forecast& forecast = forecasts[i];
+		if (forecast.included) {
+			char leave[32];
+			std::snprintf(leave, sizeof(leave), "%.1f", forecast.days_per_year);
+			row(dirs[i].filename().string(), &forecast.department, leave, forecast.p10, forecast.p50, forecast.p90);
+		}
+	}
+	for (const auto& group : group_of) {
+		std::vector<double> sums(trajectories);
+		for (size_t t = 0; t < trajectories; ++t) {
+			sums[t] = static_cast<double>((*totals[group.second])[t].load()) / 1e6;
+		}
+		row("(all)", &group.first, "", quantile(sums, 0.1), quantile(sums, 0.5), quantile(sums, 0.9));
+	}
+	if (department.empty()) {
+		std::vector<double> sums(trajectories);
+		for (size_t t = 0; t < trajectories; ++t) {
+			sums[t] = static_cast<double>(everyone[t].load()) / 1e6;
+		}
+		row("(all)", nullptr, "", quantile(sums, 0.1), quantile(sums, 0.5), quantile(sums, 0.9));
+	}
+	if (!records) {
+		write_table(std::cout, rows);
+	}
+	return failures == 0 ? 0 : 1;
+}
+
+// One row of a bulk import, parsed but not yet checked against its ledger
+struct ImportRow {
+	size_t line;
+	Date first;
+	Date last;
+	double hours;
+	LeaveKind kind;
+	std::string reason;
+};
+
+// Fills in a row's dates, hours and reason; returns why the row is rejected, or an empty string
+std::string read_import_row(const std::string& date, const std::string& end_date, double hours, std::string reason, ImportRow& row) {
+	try {
+		row.first = Date::parse(date);
+		row.last = end_date.empty() ? row.first : Date::parse(end_date);
+	}
+	catch (const std::exception& e) {
+		return e.what();
+	}
+	if (row.last < row.first) {
+		return "The end_date is before the start_date.";
+	}
+	if (!std::isfinite(hours) || hours <= 0.0) {
+		return "Hours must be a positive number.";
+	}
+	row.kind = end_date.empty() ? LeaveKind::SingleDay : LeaveKind::Range;
+	row.hours = hours;
+	row.reason = std::move(reason);
+	return std::string();
+}
+
+// Splits one CSV record into fields, with RFC 4180 quoting; false on a stray or unterminated quote
+bool split_csv_record(const char* p, const char* end, std::vector<std::string>& fields) {
+	fields.clear();
+	for (;;) {
+		std::string field;
+		if (p != end && *p == '"') {
+			for (++p;; ++p) {
+				if (p == end) {
+					return false;
+				}
+				if (*p == '"') {
+					if (p + 1 == end || p[1] != '"') {
+						++p;
+						break;
+					}
+					++p;
+				}
+				field += *p;
+			}
+			if (p != end && *p != ',') {
+				return false;
+			}
+		}
+		else {
+			const char* comma = std::find(p, end, ',');
+			if (std::find(p, comma, '"') != comma) {
+				return false;
+			}
+			field.assign(p, comma);
+			p = comma;
+		}
+		fields.push_back(std::move(field));
+		if (p == end) {
+			return true;
+		}
+		++p;
+	}
+}
+
+// Import rows filed under the ledger directory named by their "employee" field. Records are
+// parsed on the worker pool a block at a time, then filed in input order; rows that do not
+// parse or name no known ledger are kept with their line numbers for the report.
+class ImportRows {
+public:
+	explicit ImportRows(const std::vector<fs::path>& dirs) : rows_(dirs.size()) {
+		for (size_t i = 0; i < dirs.size(); ++i) {
+			ledger_of_.emplace(dirs[i].filename().string(), i);
+		}
+	}
+
+	// parse(i, employee, row) reads record i and returns why it is rejected, or an empty string
+	template <typename Fn>
+	void add_records(size_t count, const std::vector<size_t>& lines, Fn parse) {
+		struct Parsed {
+			std::string employee;
+			ImportRow row;
+			std::string error;
+		};
+		std::vector<Parsed> parsed(count);
+		const size_t block = 4096;
+		parallel_for((count + block - 1) / block, [&](size_t b) {
+			ScopedPhase phase(Phase::Parse);
+			for (size_t i = b * block; i < std::min(count, (b + 1) * block); ++i) {
+				parsed[i].error = parse(i, parsed[i].employee, parsed[i].row);
+			}
+		});
+		for (size_t i = 0; i < count; ++i) {
+			Parsed& record = parsed[i];
+			total_++;
+			if (record.error.empty()) {
+				auto ledger = ledger_of_.find(record.employee);
+				if (ledger == ledger_of_.end()) {
+					record.error = record.employee.empty() ? "No employee given." : "No ledger for employee \"" + record.employee + "\".";
+				}
+				else {
+					record.row.line = lines[i];
+					rows_[ledger->second].push_back(std::move(record.row));
+					continue;
+				}
+			}
+			rejected_.emplace_back(lines[i], std::move(record.error));
+		}
+	}
+
+	void reject(size_t line, std::string why) {
+		rejected_.emplace_back(line, std::move(why));
+	}
+
+	size_t total() const { return total_; }
+	std::vector<std::vector<ImportRow>>& rows() { return rows_; }
+	std::vector<std::pair<size_t, std::string>>& rejected() { return rejected_; }
+
+private:
+	std::unordered_map<std::string, size_t> ledger_of_;
+	std::vector<std::vector<ImportRow>> rows_;
+	std::vector<std::pair<size_t, std::string>> rejected_;
+	size_t total_ = 0;
+};
+
+// Reads an import object: "employee", then "date" or "start_date" and "end_date", with
+// optional "hours" (or "hours_per_day") and "reason", as in a days_off file
+std::string read_import_object(const json& entry, std::string& employee, ImportRow& row) {
+	if (!entry.is_object()) {
+		return "Expected a JSON object.";
+	}
+	try {
+		employee = entry.value("employee", "");
+		std::string date = entry.value("date", entry.value("start_date", ""));
+		std::string end_date = entry.contains("date") ? "" : entry.value("end_date", "");
+		if (date.empty()) {
+			return "No date or start_date given.";
+		}
+		double hours = entry.value("hours", entry.value("hours_per_day", 8.0));
+		return read_import_row(date, end_date, hours, entry.value("reason", ""), row);
+	}
+	catch (const json::type_error&) {
+		return "Dates, employee and reason must be strings and hours a number.";
+	}
+}
+
+// Bytes read from an import file at a time
+const size_t IMPORT_CHUNK_BYTES = 4 << 20;
+
+// Streams a CSV (header row naming employee, date or start_date, and optionally end_date,
+// hours or hours_per_day, and reason) or NDJSON import file a chunk at a time. Records end at
+// newlines outside quotes; each one keeps the number of the line it starts on.
+void read_import_lines(const std::string& path, bool csv, ImportRows& rows) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Cannot open " + path + ".");
+	}
+	std::vector<int> column; // employee, date, end_date, hours, reason; -1 when absent
+	std::string buffer;
+	size_t line = 1;
+	bool header = csv;
+	std::vector<char> chunk(IMPORT_CHUNK_BYTES);
+	for (;;) {
+		in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+		size_t got = static_cast<size_t>(in.gcount());
+		bool last_chunk = got == 0;
+		buffer.append(chunk.data(), got);
+
+		// Cut the buffered text into whole records
+		std::vector<std::pair<size_t, size_t>> records;
+		std::vector<size_t> lines;
+		size_t start = 0;
+		size_t start_line = line;
+		bool quoted = false;
+		// Blank lines are skipped
+		auto cut = [&](size_t end) {
+			size_t stop = end > start && buffer[end - 1] == '\r' ? end - 1 : end;
+			if (stop > start) {
+				records.emplace_back(start, stop);
+				lines.push_back(start_line);
+			}
+			start = end + 1;
+			start_line = line;
+		};
+		for (size_t i = 0; i < buffer.size(); ++i) {
+			char c = buffer[i];
+			if (c == '"' && csv) {
+				quoted = !quoted;
+			}
+			else if (c == '\n') {
+				line++;
+				if (!quoted) {
+					cut(i);
+				}
+			}
+		}
+		if (last_chunk && start < buffer.size()) {
+			cut(buffer.size());
+		}
+		line = start_line;
+
+		size_t skip = 0;
+		if (header && !records.empty()) {
+			std::vector<std::string> names;
+			if (!split_csv_record(buffer.data() + records[0].first, buffer.data() + records[0].second, names)) {
+				throw std::runtime_error("Unreadable CSV header in " + path + ".");
+			}
+			auto find = [&](std::initializer_list<const char*> options) {
+				for (const char* option : options) {
+					auto found = std::find(names.begin(), names.end(), option);
+					if (found != names.end()) {
+						return static_cast<int>(found - names.begin());
+					}
+				}
+				return -1;
+			};
+			column = { find({ "employee" }), find({ "date", "start_date" }), find({ "end_date" }), find({ "hours", "hours_per_day" }), find({ "reason" }) };
+			if (column[0] < 0 || column[1] < 0) {
+				throw std::runtime_error("The CSV header in " + path + " needs employee and date (or start_date) columns.");
+			}
+			header = false;
+			skip = 1;
+		}
+
+		const char* text = buffer.data();
+		rows.add_records(records.size() - skip, std::vector<size_t>(lines.begin() + static_cast<std::ptrdiff_t>(skip), lines.end()),
+			[&](size_t i, std::string& employee, ImportRow& row) -> std::string {
+				const auto& record = records[i + skip];
+				if (!csv) {
+					json entry = json::parse(text + record.first, text + record.second, nullptr, false);
+					return entry.is_discarded() ? "Invalid JSON." : read_import_object(entry, employee, row);
+				}
+				std::vector<std::string> fields;
+				if (!split_csv_record(text + record.first, text + record.second, fields)) {
+					return "Unbalanced quotes.";
+				}
+				auto get = [&](int k) {
+					return k >= 0 && static_cast<size_t>(k) < fields.size() ? fields[static_cast<size_t>(k)] : std::string();
+				};
+				employee = get(column[0]);
+				double hours = 8.0;
+				std::string hours_text = get(column[3]);
+				if (!hours_text.empty()) {
+					char* stop = nullptr;
+					hours = std::strtod(hours_text.c_str(), &stop);
+					if (*stop != '\0') {
+						return "Invalid hours \"" + hours_text + "\".";
+					}
+				}
+				return read_import_row(get(column[1]), get(column[2]), hours, get(column[4]), row);
+			});
+		buffer.erase(0, start);
+		if (last_chunk) {
+			break;
 		}
 	}
-	return false;
 }
 
-// this needs to check if the date provided is contained within any days off entries
-// including date, start_date, end_date, and between start_date & end_date
-static bool is_day_off(const nlohmann::json& days_off, const std::string& date) {
-	// check specific dates
-	// check date ranges
-
-}
+// Checks one ledger's import rows against its entries and each other, then writes the ledger
+// once with the accepted rows merged in date order. Returns how many rows went in; rejected
+// rows are added to `rejected`.
+size_t import_into_ledger(const fs::path& dir, const HolidayCalendars& calendars, std::vector<ImportRow>& rows,
+	std::vector<std::pair<size_t, std::string>>& rejected) {
+	json settings = load_document(find_document((dir / LEDGER_SETTINGS_NAME).string()));
+	const BusinessCalendar& calendar = calendars.for_settings(settings);
+	LedgerFile file(days_off_path_for((dir / LEDGER_DAYS_OFF_NAME).string(), settings));
+	LeaveStore days_off = file.load();
+	DaysOffIndex index(days_off, calendar);
 
-std::tm date_string_to_tm(const std::string& date_str) {
-	std::tm tm = {};
-	std::istringstream ss(date_str);
-	ss >> std::get_time(&tm, "%Y-%m-%d");
-	if (ss.fail()) {
-		throw std::runtime_error("Invalid date format. Use YYYY-MM-DD.");
+	// Rows are checked in input order, as adding them one at a time would, against the ledger
+	// and the rows accepted so far (disjoint, keyed by first day)
+	ScopedPhase phase(Phase::Compute);
+	std::map<Date, const ImportRow*> accepted;
+	for (const ImportRow& row : rows) {
+		std::string conflict = row.kind == LeaveKind::SingleDay ? day_off_conflict(index, row.first)
+			: range_days_off_conflict(index, row.first, row.last);
+		auto after = accepted.upper_bound(row.last);
+		if (conflict.empty() && after != accepted.begin() && std::prev(after)->second->last >= row.first) {
+			conflict = "Overlaps the entry imported from line " + std::to_string(std::prev(after)->second->line) + ".";
+		}
+		if (!conflict.empty()) {
+			rejected.emplace_back(row.line, std::move(conflict));
+			continue;
+		}
+		accepted.emplace_hint(after, row.first, &row);
+	}
+	if (accepted.empty()) {
+		return 0;
 	}
-	tm.tm_hour = 0;
-	tm.tm_min = 0;
-	tm.tm_sec = 0;
-	return tm;
-}
-
-std::string tm_to_date_string(const std::tm& tm) {
-	std::ostringstream oss;
-	oss << std::put_time(&tm, "%Y-%m-%d");
-	return oss.str();
-}
 
-bool is_weekday(const std::tm& tm) {
-	std::time_t t = std::mktime(const_cast<std::tm*>(&tm));
-	std::tm* lt = std::localtime(&t);
-	return lt->tm_wday != 0 && lt->tm_wday != 6; // not Sunday or Saturday
+	std::vector<size_t> order(days_off.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return days_off.first[a] < days_off.first[b]; });
+	LeaveStore merged;
+	merged.reserve(days_off.size() + accepted.size());
+	size_t next = 0;
+	for (const auto& entry : accepted) {
+		const ImportRow* row = entry.second;
+		for (; next < order.size() && days_off.first[order[next]] <= row->first; ++next) {
+			size_t i = order[next];
+			merged.add(days_off.first[i], days_off.last[i], days_off.hours[i], days_off.kind[i], days_off.reason(i));
+		}
+		merged.add(row->first, row->last, row->hours, row->kind, row->reason);
+	}
+	for (; next < order.size(); ++next) {
+		size_t i = order[next];
+		merged.add(days_off.first[i], days_off.last[i], days_off.hours[i], days_off.kind[i], days_off.reason(i));
+	}
+	if (!file.compact(merged)) {
+		throw std::runtime_error("Could not write " + file.snapshot_path() + ".");
+	}
+	save_checkpoints(settings, merged, calendar, file.snapshot_path());
+	return accepted.size();
 }
 
-int working_days_elapsed_since(const std::tm& start_date) {
-	std::time_t now = std::time(nullptr);
-	std::tm today = *std::localtime(&now);
+// Bulk-imports leave into the ledgers of a directory or manifest from a CSV or NDJSON file
+// (streamed) or a JSON array of entries (numbered from 1 in place of lines). Every row is
+// validated like add and add_range, plus against the other imported rows; each touched ledger
+// is written once. Rejected rows are reported by line and do not stop the others.
+int run_import(const std::string& source, const std::string& path) {
+	std::vector<fs::path> dirs = find_ledger_dirs(source);
+	HolidayCalendars calendars(load_holiday_dates(HOLIDAYS_FILE));
+	ImportRows rows(dirs);
+	std::string extension = fs::path(path).extension().string();
+	if (extension == ".json") {
+		json entries;
+		{
+			ScopedPhase phase(Phase::Parse);
+			entries = json::parse(read_file(path));
+		}
+		if (!entries.is_array()) {
+			throw std::runtime_error(path + " is not a JSON array of entries.");
+		}
+		std::vector<size_t> numbers(entries.size());
+		std::iota(numbers.begin(), numbers.end(), 1);
+		rows.add_records(entries.size(), numbers, [&](size_t i, std::string& employee, ImportRow& row) {
+			return read_import_object(entries[i], employee, row);
+		});
+	}
+	else {
+		read_import_lines(path, extension != ".ndjson" && extension != ".jsonl", rows);
+	}
 
-	std::time_t start = std::mktime(const_cast<std::tm*>(&start_date));
-	std::time_t end = std::mktime(&today);
+	std::vector<size_t> imported(dirs.size(), 0);
+	std::vector<std::vector<std::pair<size_t, std::string>>> rejected(dirs.size());
+	std::vector<std::string> errors(dirs.size());
+	parallel_for(dirs.size(), [&](size_t i) {
+		if (rows.rows()[i].empty()) {
+			return;
+		}
+		try {
+			imported[i] = import_into_ledger(dirs[i], calendars, rows.rows()[i], rejected[i]);
+		}
+		catch (const std::exception& e) {
+			errors[i] = e.what();
+		}
+	});
 
-	int weekdays_elapsed = 0;
-	for (std::time_t t = start; t <= end; t += 86400) {
-		std::tm* tm = std::localtime(&t);
-		if (is_weekday(*tm)) {
-			weekdays_elapsed++;
+	ScopedPhase phase(Phase::Render);
+	std::vector<std::pair<size_t, std::string>>& report = rows.rejected();
+	size_t total_imported = 0;
+	size_t ledgers = 0;
+	int failures = 0;
+	for (size_t i = 0; i < dirs.size(); ++i) {
+		if (!errors[i].empty()) {
+			std::cerr << "Error: " << dirs[i].filename().string() << ": " << errors[i] << " (" << rows.rows()[i].size() << " rows not imported)\n";
+			failures++;
+			continue;
 		}
+		report.insert(report.end(), rejected[i].begin(), rejected[i].end());
+		total_imported += imported[i];
+		ledgers += imported[i] > 0;
+	}
+	std::sort(report.begin(), report.end());
+	const char* unit = extension == ".json" ? "entry" : "line";
+	for (const auto& row : report) {
+		std::cerr << "Rejected " << unit << " " << row.first << ": " << row.second << "\n";
 	}
-	return weekdays_elapsed;
+	std::cout << "Imported " << total_imported << " of " << rows.total() << " rows into " << ledgers << " ledgers";
+	if (!report.empty()) {
+		std::cout << "; " << report.size() << " rejected";
+	}
+	std::cout << ".\n";
+	return failures == 0 && report.empty() ? 0 : 1;
 }
 
-double calculate_accrued_hours_to(const json& days_off, const std::tm& from_date, const std::tm& to_date, double accrual_rate) {
-	std::time_t start = std::mktime(const_cast<std::tm*>(&from_date));
-	std::time_t end = std::mktime(const_cast<std::tm*>(&to_date));
+// Size and modification time of a file, to tell whether it changed since last seen
+struct FileStamp {
+	bool exists = false;
+	uintmax_t size = 0;
+	fs::file_time_type mtime;
 
-	double accrued = 0.0;
-	for (std::time_t t = start; t <= end; t += 86400) {
-		std::tm* tm = std::localtime(&t);
-		if (is_weekday(*tm)) {
-			accrued += accrual_rate;
+	static FileStamp of(const std::string& path) {
+		FileStamp stamp;
+		std::error_code ec;
+		stamp.mtime = fs::last_write_time(path, ec);
+		if (!ec) {
+			stamp.exists = true;
+			stamp.size = fs::file_size(path, ec);
 		}
+		return stamp;
 	}
-	return accrued;
-}
 
-double calculate_accrued_hours(const json& days_off, const std::tm& start_date, double accrual_rate) {
-	std::time_t now = std::time(nullptr);
-	std::tm today = *std::localtime(&now);
+	bool operator==(const FileStamp& other) const {
+		return exists == other.exists && size == other.size && mtime == other.mtime;
+	}
+	bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+// A ledger held in memory by `pto serve`: settings, days off and their index, the journal
+// that persists edits, and stamps of the files as last read or written
+struct ResidentLedger {
+	fs::path dir;
+	json settings;
+	const BusinessCalendar* calendar = nullptr;
+	LedgerFile file;
+	LeaveStore days_off;
+	std::unique_ptr<DaysOffIndex> index;
+	AccrualPolicy policy;
+	std::unique_ptr<AccrualPlan> plan;
+	std::unique_ptr<BalanceTimeline> timeline; // built by the first balance query, then patched by edits
+	FileStamp settings_stamp;
+	FileStamp snapshot_stamp;
+	FileStamp journal_stamp;
 
-	std::time_t start = std::mktime(const_cast<std::tm*>(&start_date));
-	std::time_t end = std::mktime(&today);
+	explicit ResidentLedger(const std::string& days_off_path) : file(days_off_path) {}
 
-	double accrued = 0.0;
-	for (std::time_t t = start; t <= end; t += 86400) {
-		std::tm* tm = std::localtime(&t);
-		if (is_weekday(*tm)) {
-			accrued += accrual_rate;
-		}
+	std::string settings_path() const {
+		return find_document((dir / LEDGER_SETTINGS_NAME).string());
 	}
-	return accrued;
-}
 
-double calculate_hours_of_days_off(const json& days_off) {
-	double used_hours = 0.0;
+	void reindex() {
+		timeline.reset();
+		index.reset(new DaysOffIndex(days_off, *calendar));
+		replan();
+	}
 
-	for (const auto& entry : days_off) {
-		if (entry.contains("date")) {
-			used_hours += entry.value("hours", 8.0);
+	// Recompiles the accrual plan after the policy changed
+	void replan() {
+		timeline.reset();
+		plan.reset(new AccrualPlan(policy, *index));
+	}
+
+	// Patches an edit of the days off into the index and the timeline, replanning only if the
+	// plan reads usage
+	void apply(const LeaveDiff& diff) {
+		index->apply(diff);
+		std::unique_ptr<AccrualPlan> before;
+		if (policy.needs_usage()) {
+			before = std::move(plan);
+			plan.reset(new AccrualPlan(policy, *index));
 		}
-		else if (entry.contains("start_date") && entry.contains("end_date")) {
-			std::tm start_tm = date_string_to_tm(entry["start_date"]);
-			std::tm end_tm = date_string_to_tm(entry["end_date"]);
-			double hours_per_day = entry.value("hours_per_day", 8.0);
+		if (timeline) {
+			timeline->apply(diff, *plan);
+		}
+	}
 
-			std::time_t start = std::mktime(&start_tm);
-			std::time_t end = std::mktime(&end_tm);
+	void stamp_days_off() {
+		snapshot_stamp = FileStamp::of(file.snapshot_path());
+		journal_stamp = FileStamp::of(file.journal_path());
+	}
 
-			for (std::time_t t = start; t <= end; t += 86400) {
-				std::tm* current_tm = std::localtime(&t);
-				if (is_weekday(*current_tm)) {
-					used_hours += hours_per_day;
-				}
-			}
+	// Brings a carryover ledger's checkpoints up to date after an edit, as the CLI edit
+	// commands do
+	void save_checkpoints() const {
+		if (policy.carries_over()) {
+			checkpointed_plan(policy, *index, checkpoint_path_for(file.snapshot_path()), today(), true);
 		}
 	}
 
-	return used_hours;
-}
+	// Daily balances through a year from today (or the last leave), built on first use
+	const BalanceTimeline& balances() {
+		if (!timeline) {
+			timeline.reset(new BalanceTimeline(*plan, balance_horizon(*index, today() + 366), *index));
+		}
+		return *timeline;
+	}
 
-void save_days_off(const std::string& path, const json& days_off) {
-	std::ofstream ofs(path);
-	if (!ofs) {
-		std::cerr << "Error: Unable to write to " << path << "\n";
-		return;
+	bool days_off_changed() const {
+		return snapshot_stamp != FileStamp::of(file.snapshot_path()) || journal_stamp != FileStamp::of(file.journal_path());
 	}
-	ofs << days_off.dump(4); // pretty print
-}
+};
 
-void list_days_off(const json& days_off) {
-	if (days_off.empty()) {
-		std::cout << "No days off recorded.\n";
-		return;
+// Tells which resident ledgers' directories saw file changes: inotify on Linux, or a
+// once-a-second stat of each ledger's files elsewhere and for directories beyond the inotify
+// watch limit
+class LedgerWatcher {
+public:
+	LedgerWatcher() {
+#ifdef __linux__
+		fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
 	}
-	std::cout << "-------------------------------------------------------------------------------\n";
-	std::cout << std::left << std::setw(25) << "Date/Range"
-		<< std::right << std::setw(18) << "Type"
-		<< std::right << std::setw(14) << "Hours"
-		<< std::right << std::setw(20) << "Reason" << "\n";
-	std::cout << "-------------------------------------------------------------------------------\n";
-	for (const auto& entry : days_off) {
-		std::string reason = entry.value("reason", "");
-		if (entry.contains("date")) {
-			std::cout << std::left << std::setw(25) << std::string(entry["date"])
-				<< std::right << std::setw(18) << "Single Day"
-				<< std::right << std::setw(14) << entry.value("hours", 8.0)
-				<< std::right << std::setw(20) << reason
-				<< "\n";
+
+	~LedgerWatcher() {
+#ifdef __linux__
+		if (fd_ >= 0) {
+			close(fd_);
 		}
-		else if (entry.contains("start_date")) {
-			std::string range = std::string(entry["start_date"]) + " to " + std::string(entry["end_date"]);
-			std::cout << std::left << std::setw(25) << range
-				<< std::right << std::setw(18) << "Range"
-				<< std::right << std::setw(14) << entry.value("hours_per_day", 8.0)
-				<< std::right << std::setw(20) << reason
-				<< "\n";
+#endif
+	}
+
+	LedgerWatcher(const LedgerWatcher&) = delete;
+	LedgerWatcher& operator=(const LedgerWatcher&) = delete;
+
+	void watch(ResidentLedger* ledger) {
+#ifdef __linux__
+		if (fd_ >= 0) {
+			int wd = inotify_add_watch(fd_, ledger->dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+			if (wd >= 0) {
+				watched_[wd] = ledger;
+				return;
+			}
 		}
+#endif
+		polled_.push_back(ledger);
 	}
-	std::cout << "-------------------------------------------------------------------------------\n";
-}
 
-// Print the days that have been taken off using tabulate
-void list_days_off_tabulate(const json& days_off) {
-	std::cout << "Logged Time Off\n";
-	Table table;
-	table.add_row({ "Date/Range", "Type", "Time Off", "Reason" });
-	for (const auto& entry : days_off) {
-		std::string reason = entry.value("reason", "");
-		if (entry.contains("date")) {
-			std::string time_off = format_hrs(entry.value("hours", 8.0));
-			table.add_row({ std::string(entry["date"]), "Single Day", time_off, reason });
+	// Descriptor to poll for inotify events, -1 if there is none
+	int fd() const { return fd_; }
+
+	// Milliseconds until the next stat sweep is due, -1 if nothing is polled
+	int poll_timeout() const {
+		if (polled_.empty()) {
+			return -1;
 		}
-		else if (entry.contains("start_date")) {
-			std::string range = std::string(entry["start_date"]) + " to " + std::string(entry["end_date"]);
-			double hours_per_day = entry.value("hours_per_day", 8.0);
-			std::tm start_tm = date_string_to_tm(entry["start_date"]);
-			std::tm end_tm = date_string_to_tm(entry["end_date"]);
-			std::time_t start = std::mktime(&start_tm);
-			std::time_t end = std::mktime(&end_tm);
-			int weekday_count = 0;
-			for (std::time_t t = start; t <= end; t += 86400) {
-				std::tm* current_tm = std::localtime(&t);
-				if (is_weekday(*current_tm)) {
-					weekday_count++;
+		auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_sweep_ - std::chrono::steady_clock::now()).count();
+		return static_cast<int>(std::max<long long>(0, wait));
+	}
+
+	// Ledgers whose directories had events, plus every polled ledger when a sweep is due
+	// (those are checked against their stamps by the caller). Each ledger appears once.
+	std::vector<ResidentLedger*> changed() {
+		std::vector<ResidentLedger*> found;
+#ifdef __linux__
+		alignas(inotify_event) char buffer[64 * 1024];
+		ssize_t n;
+		while (fd_ >= 0 && (n = read(fd_, buffer, sizeof(buffer))) > 0) {
+			for (char* p = buffer; p < buffer + n; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len) {
+				const inotify_event* event = reinterpret_cast<inotify_event*>(p);
+				if (event->mask & IN_Q_OVERFLOW) {
+					// Events were dropped: check everything against its stamps
+					for (const auto& watched : watched_) {
+						found.push_back(watched.second);
+					}
+					continue;
+				}
+				auto watched = watched_.find(event->wd);
+				if (watched != watched_.end()) {
+					found.push_back(watched->second);
 				}
 			}
-			double total_time_off = weekday_count * hours_per_day;
-			table.add_row({ range, "Range", format_hrs(total_time_off), reason });
 		}
+#endif
+		if (!polled_.empty() && std::chrono::steady_clock::now() >= next_sweep_) {
+			found.insert(found.end(), polled_.begin(), polled_.end());
+			next_sweep_ = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		}
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+		return found;
 	}
-	std::cout << table << std::endl;
-	std::cout << "\n";
-}
 
-bool is_future_date(std::tm& input_tm) {
+	size_t watched() const { return watched_.size(); }
+	size_t polled() const { return polled_.size(); }
+
+private:
+	int fd_ = -1;
+	std::unordered_map<int, ResidentLedger*> watched_;
+	std::vector<ResidentLedger*> polled_;
+	std::chrono::steady_clock::time_point next_sweep_ = std::chrono::steady_clock::now();
+};
 
-	input_tm.tm_hour = 0; 
-	input_tm.tm_min = 0; 
-	input_tm.tm_sec = 0;
+// Answers newline-delimited JSON requests against every ledger of a directory or manifest,
+// all kept in memory. Each request names a ledger and an op:
+//   {"op": "summary", "ledger": "emp00001"}
+//   {"op": "balance", "ledger": ..., "date": "2026-03-02"}
+//   {"op": "is_day_off", "ledger": ..., "date": ...}
+//   {"op": "add", "ledger": ..., "date": ..., "end_date": ..., "hours": 8, "reason": ...}
+//   {"op": "remove", "ledger": ..., "date": ...}
+// and gets one line back: {"ok": true, ...} or {"ok": false, "error": "..."}. Edits go
+// through each ledger's journal before they are acknowledged, and a failed write leaves the
+// ledger as it was.
+class PtoServer {
+public:
+	explicit PtoServer(const std::string& source) : calendars_(load_holiday_dates(HOLIDAYS_FILE)) {
+		std::vector<fs::path> dirs = find_ledger_dirs(source);
+		std::vector<std::unique_ptr<ResidentLedger>> loaded(dirs.size());
+		std::vector<std::string> errors(dirs.size());
+		parallel_for(dirs.size(), [&](size_t i) {
+			try {
+				json settings = load_document(find_document((dirs[i] / LEDGER_SETTINGS_NAME).string()));
+				std::unique_ptr<ResidentLedger> ledger(new ResidentLedger(days_off_path_for((dirs[i] / LEDGER_DAYS_OFF_NAME).string(), settings)));
+				ledger->dir = dirs[i];
+				ledger->settings_stamp = FileStamp::of(ledger->settings_path());
+				ledger->stamp_days_off();
+				ledger->settings = std::move(settings);
+				ledger->calendar = &calendars_.for_settings(ledger->settings);
+				ledger->policy = accrual_policy_for(ledger->settings);
+				ledger->days_off = ledger->file.load();
+				ledger->reindex();
+				loaded[i] = std::move(ledger);
+			}
+			catch (const std::exception& e) {
+				errors[i] = e.what();
+			}
+		});
+		for (size_t i = 0; i < dirs.size(); ++i) {
+			std::string id = dirs[i].filename().string();
+			if (!loaded[i]) {
+				std::cerr << "Warning: Skipping ledger " << id << ": " << errors[i] << "\n";
+			}
+			else if (!ledgers_.emplace(id, std::move(loaded[i])).second) {
+				std::cerr << "Warning: Skipping duplicate ledger " << id << " (" << dirs[i].string() << ")\n";
+			}
+		}
+		for (auto& entry : ledgers_) {
+			watcher_.watch(entry.second.get());
+		}
+	}
 
-	std::time_t input_time = std::mktime(&input_tm);
+	size_t size() const { return ledgers_.size(); }
 
-	// Get today's date, set to midnight
-	std::time_t now = std::time(nullptr);
-	std::tm today_tm = *std::localtime(&now);
-	today_tm.tm_hour = 0; today_tm.tm_min = 0; today_tm.tm_sec = 0;
-	std::time_t today_time = std::mktime(&today_tm);
+	json handle(const json& request) {
+		try {
+			std::string op = request.value("op", "");
+			if (op != "summary" && op != "balance" && op != "is_day_off" && op != "add" && op != "remove") {
+				return failure("Unknown op \"" + op + "\".");
+			}
+			auto found = ledgers_.find(request.value("ledger", ""));
+			if (found == ledgers_.end()) {
+				return failure("Unknown ledger.");
+			}
+			ResidentLedger& ledger = *found->second;
+			const DaysOffIndex& index = *ledger.index;
+			if (op == "summary") {
+				PtoSummary summary = compute_pto_summary(*ledger.plan, calculate_hours_of_days_off(index), *ledger.calendar);
+				return { {"ok", true}, {"working_days", summary.working_days}, {"accrued", summary.accrued},
+					{"used", summary.used}, {"expired", summary.expired}, {"balance", summary.balance} };
+			}
+			Date day = Date::parse(request.at("date").get<std::string>());
+			if (op == "balance") {
+				const BalanceTimeline& timeline = ledger.balances();
+				return { {"ok", true}, {"date", day.to_string()}, {"accrued", timeline.accrued_on(day)}, {"used", timeline.used_through(day)},
+					{"expired", ledger.plan->expired_through(day)}, {"balance", timeline.balance_on(day)} };
+			}
+			if (op == "is_day_off") {
+				return { {"ok", true}, {"date", day.to_string()}, {"day_off", is_day_off(index, day)} };
+			}
+			if (op == "remove") {
+				LeaveDiff diff = diff_remove_starting_on(ledger.days_off, day);
+				if (!diff.removed.empty()) {
+					// The journal compacts from the store after the removal, so keep the one before
+					// to put back if the write fails
+					LeaveStore before = ledger.days_off;
+					ledger.days_off.remove_starting_on(day);
+					bool saved = ledger.file.append_remove(day, ledger.days_off);
+					ledger.stamp_days_off();
+					if (!saved) {
+						ledger.days_off = std::move(before);
+						return failure("Unable to write the journal.");
+					}
+					ledger.apply(diff);
+					ledger.save_checkpoints();
+				}
+				return { {"ok", true}, {"removed", diff.removed.size()} };
+			}
+			return add(ledger, day, request);
+		}
+		catch (const std::exception& e) {
+			return failure(e.what());
+		}
+	}
 
-	return input_time > today_time;
-}
+	// Serves requests on a Unix domain socket from a single poll() loop until SIGINT or
+	// SIGTERM. Requests are answered as soon as their line is complete; replies that do not
+	// fit in the socket buffer wait for POLLOUT.
+	int run(const std::string& socket_path);
 
-void print_usage() {
-	std::cout << "Usage (date format used: yyyy-mm-dd):\n"
-		<< "  pto                        Show available PTO\n"
-		<< "  pto add <date> [hours]     Add a day off (default: 8 hours)\n"
-		<< "  pto add_range <start> <end> [hours/day]  Add range of days off (default: 8)\n"
-		<< "  pto remove <date>          Remove entries matching a date (exact match to 'date' or 'start_date')\n"
-		<< "  pto show_days_off          Show all saved days off\n"
-		<< "  pto show_hrs_on <date>     Show amount of accrued hours on some future date\n"
-		<< "  pto usage                  Show this help message\n\n";
-}
+private:
+	static json failure(const std::string& error) {
+		return { {"ok", false}, {"error", error} };
+	}
 
-// TODO: show hours accrued on a date - this can be used to look ahead and know how much vaca time I'll have by
-// that date, assuming I don't take any additional time off between now and then.
-// Show accrued hours on a specific future date
-void show_hrs_on(const json& settings, const json& days_off, const std::string& future_date) {
-    std::tm future_date_tm = date_string_to_tm(future_date);
+	json add(ResidentLedger& ledger, Date day, const json& request) {
+		bool range = request.contains("end_date");
+		Date end = range ? Date::parse(request["end_date"].get<std::string>()) : day;
+		std::string conflict = range ? range_days_off_conflict(*ledger.index, day, end) : day_off_conflict(*ledger.index, day);
+		if (!conflict.empty()) {
+			return failure(conflict);
+		}
+		double hours = request.value(range ? "hours_per_day" : "hours", request.value("hours", 8.0));
+		ledger.days_off.add(day, end, hours, range ? LeaveKind::Range : LeaveKind::SingleDay, request.value("reason", ""));
+		bool saved = ledger.file.append_add(ledger.days_off, ledger.days_off.size() - 1);
+		ledger.stamp_days_off();
+		if (!saved) {
+			ledger.days_off.remove_starting_on(day);
+			return failure("Unable to write the journal.");
+		}
+		ledger.apply(diff_append(ledger.days_off));
+		ledger.save_checkpoints();
+		return { {"ok", true} };
+	}
 
-    // should this matter?
-    if (!is_weekday(future_date_tm)) {
-        std::cerr << "Error: Trying to show a date in the future that is a weekend.\n";
-        return;
-    }
+	// Picks up edits other programs made to a ledger's files. New settings replace the old
+	// ones (reloading the days off too if they moved to another file or calendar); new days
+	// off are diffed against the resident ones and only the difference is patched into the
+	// index and the balance timeline. Files that still match their stamps, such as the server's own journal appends,
+	// are not read again. A ledger that fails to parse keeps its last good state.
+	void reload(ResidentLedger& ledger) {
+		try {
+			FileStamp settings_stamp = FileStamp::of(ledger.settings_path());
+			bool full = false;
+			if (settings_stamp != ledger.settings_stamp) {
+				json settings = load_document(ledger.settings_path());
+				std::string days_off_path = days_off_path_for((ledger.dir / LEDGER_DAYS_OFF_NAME).string(), settings);
+				const BusinessCalendar* calendar = &calendars_.for_settings(settings);
+				AccrualPolicy policy = accrual_policy_for(settings);
+				full = days_off_path != ledger.file.snapshot_path() || calendar != ledger.calendar;
+				if (full) {
+					LedgerFile file(days_off_path);
+					LeaveStore days_off = file.load();
+					ledger.file = std::move(file);
+					ledger.days_off = std::move(days_off);
+					ledger.calendar = calendar;
+					ledger.policy = policy;
+					ledger.reindex();
+					ledger.stamp_days_off();
+				}
+				else {
+					ledger.policy = policy;
+					ledger.replan();
+				}
+				ledger.settings = std::move(settings);
+				ledger.settings_stamp = settings_stamp;
+			}
+			if (!full && ledger.days_off_changed()) {
+				FileStamp snapshot_stamp = FileStamp::of(ledger.file.snapshot_path());
+				FileStamp journal_stamp = FileStamp::of(ledger.file.journal_path());
+				LedgerFile file(ledger.file.snapshot_path());
+				LeaveStore days_off = file.load();
+				ledger.apply(diff_leave(ledger.days_off, days_off));
+				ledger.file = std::move(file);
+				ledger.days_off = std::move(days_off);
+				ledger.snapshot_stamp = snapshot_stamp;
+				ledger.journal_stamp = journal_stamp;
+			}
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Warning: Keeping the previous state of " << ledger.dir.string() << ": " << e.what() << "\n";
+		}
+	}
 
-    // check that it is a date in the future
-    if (is_future_date(future_date_tm)) {
-        // accrue hours between when i started and then
-        std::tm start_tm = date_string_to_tm(settings["start_date"]);
-        double accrual_rate = settings["accrual_rate_per_day"];
-        double accrued_hours = calculate_accrued_hours_to(days_off, start_tm, future_date_tm, accrual_rate);
+	HolidayCalendars calendars_;
+	std::unordered_map<std::string, std::unique_ptr<ResidentLedger>> ledgers_;
+	LedgerWatcher watcher_;
+};
 
-        double hours_taken_off = calculate_hours_of_days_off(days_off);
-        double hours_available = accrued_hours - hours_taken_off;
+#ifdef _WIN32
+int PtoServer::run(const std::string&) {
+	std::cerr << "Error: pto serve needs Unix domain sockets and is not available on Windows.\n";
+	return 1;
+}
+#else
+volatile sig_atomic_t server_stop_requested = 0;
 
-        std::cout << "Accrued hours to then: " << format_hrs(hours_available) << " hours.\n";
-    }
-    else {
-        std::cerr << "Error: The date provided is not in the future.\n";
-    }
+void request_server_stop(int) {
+	server_stop_requested = 1;
 }
 
-// Add a single day off
-void add_day_off(json& days_off, const std::string& date, double hours, const std::string& reason) {
-    if (entry_exists(days_off, "date", date)) {
-        std::cerr << "Error: A time-off entry for " << date << " already exists.\n";
-        return;
-    }
-    std::tm date_tm = date_string_to_tm(date);
-    if (!is_weekday(date_tm)) {
-        std::cerr << "Error: Trying to add a date that is a weekend.\n";
-        return;
-    }
-    days_off.push_back({ {"date", date}, {"hours", hours}, {"reason", reason} });
-    save_days_off(DAYS_OFF_FILE, days_off);
-    std::cout << "Added day off: " << date << " (" << hours << "h, Reason: " << reason << ")\n";
+bool set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
 }
 
-// Add a range of days off
-void add_range_days_off(json& days_off, const std::string& start, const std::string& end, double hours_per_day, const std::string& reason) {
-	if (entry_exists(days_off, "date", start) || entry_exists(days_off, "date", end) ||
-		entry_exists(days_off, "start_date", start) || entry_exists(days_off, "start_date", end) ||
-		entry_exists(days_off, "end_date", start) || entry_exists(days_off, "end_date", end)) {
-		std::cerr << "Error: A time-off entry already exists for the start or end date.\n";
-		return;
+int PtoServer::run(const std::string& socket_path) {
+	// Longest request line accepted before the connection is dropped
+	const size_t MAX_REQUEST_BYTES = 1 << 20;
+
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "Error: Socket path is too long: " << socket_path << "\n";
+		return 1;
 	}
-	std::tm start_tm = date_string_to_tm(start);
-	if (!is_weekday(start_tm)) {
-		std::cerr << "Error: Trying to add a start_date that is a weekend.\n";
-		return;
+	std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+	// A socket left by a server that did not shut down cleanly; never remove anything else
+	std::error_code ec;
+	if (fs::is_socket(socket_path, ec)) {
+		fs::remove(socket_path, ec);
 	}
-	std::tm end_tm = date_string_to_tm(end);
-	if (!is_weekday(end_tm)) {
-		std::cerr << "Error: Trying to add a end_date that is a weekend.\n";
-		return;
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+		listen(listener, SOMAXCONN) != 0 || !set_nonblocking(listener)) {
+		std::cerr << "Error: Unable to listen on " << socket_path << ": " << std::strerror(errno) << "\n";
+		if (listener >= 0) {
+			close(listener);
+		}
+		return 1;
 	}
-	days_off.push_back({
-		{"start_date", start},
-		{"end_date", end},
-		{"hours_per_day", hours_per_day},
-		{"reason", reason}
-		});
-	save_days_off(DAYS_OFF_FILE, days_off);
-	std::cout << "Added days off: " << start << " to " << end << " (" << hours_per_day << "h/day, Reason: " << reason << ")\n";
-}
 
-// Print the days that have been taken off and a summary
-void print_pto_summary(const json& settings, const json& days_off) {
-    std::tm start_tm = date_string_to_tm(settings["start_date"]);
-    double accrual_rate = settings["accrual_rate_per_day"];
-	std::string accrual_rate_str = std::to_string(accrual_rate) + " hours/day";
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, request_server_stop);
+	signal(SIGTERM, request_server_stop);
+	std::cout << "Serving " << size() << " ledgers on " << socket_path << " (" << watcher_.watched()
+		<< " watched for changes, " << watcher_.polled() << " polled)" << std::endl;
 
-    double accrued_hours_since_hired = calculate_accrued_hours(days_off, start_tm, accrual_rate);
-    int working_days_since_hired = working_days_elapsed_since(start_tm);
-	std::string working_days_since_hired_str = std::to_string(working_days_since_hired) + " days";
-    double hours_taken_off = calculate_hours_of_days_off(days_off);
-    double hours_available = accrued_hours_since_hired - hours_taken_off;
+	struct Connection {
+		int fd;
+		std::string in;
+		std::string out;
+		bool closing = false;
+	};
+	std::vector<Connection> connections;
+	std::vector<pollfd> fds;
+	char buffer[64 * 1024];
 
-    std::cout << "\n===============================================\n";
-    std::cout << "         Paid Time Off Tracker          \n";
-    std::cout <<   "===============================================\n\n";
+	while (!server_stop_requested) {
+		fds.clear();
+		fds.push_back({ listener, POLLIN, 0 });
+		fds.push_back({ watcher_.fd(), POLLIN, 0 });
+		for (const Connection& c : connections) {
+			fds.push_back({ c.fd, static_cast<short>(c.out.empty() ? POLLIN : POLLIN | POLLOUT), 0 });
+		}
+		if (poll(fds.data(), fds.size(), watcher_.poll_timeout()) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::cerr << "Error: poll failed: " << std::strerror(errno) << "\n";
+			break;
+		}
 
-    
-    list_days_off_tabulate(days_off);
+		// Outside edits are applied before any request that arrived with them is answered
+		for (ResidentLedger* ledger : watcher_.changed()) {
+			reload(*ledger);
+		}
 
-	std::cout << "Summary\n";
-    Table summary_table;
-    summary_table.add_row({"Accrual Rate:", accrual_rate_str});
-    summary_table.add_row({"Working Days Since Hired:", working_days_since_hired_str});
-    summary_table.add_row({"Time Accrued:", format_hrs(accrued_hours_since_hired)});
-    summary_table.add_row({"Time Used:", format_hrs(hours_taken_off)});
-    summary_table.add_row({"Time Balance:", format_hrs(hours_available)});
-	if (hours_available < 0) {
-        int days_needed = static_cast<int>(std::ceil(std::abs(hours_available) / accrual_rate));
-		summary_table.add_row({"Days Needed To Get To 0:", std::to_string(days_needed)});
-    }
-    if (hours_available > 40) {
-		summary_table.add_row({"You Have A Problem", "YES, YOU SHOULD TAKE SOME VACATION!"});
-    }
-    std::cout << summary_table << std::endl;
+		for (size_t i = 0; i < connections.size(); ++i) {
+			Connection& c = connections[i];
+			short revents = fds[i + 2].revents;
+			if (revents & (POLLIN | POLLHUP | POLLERR)) {
+				for (;;) {
+					ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+					if (n > 0) {
+						c.in.append(buffer, static_cast<size_t>(n));
+						continue;
+					}
+					if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+						c.closing = true;
+					}
+					if (n < 0 && errno == EINTR) {
+						continue;
+					}
+					break;
+				}
+				size_t start = 0;
+				for (size_t end; (end = c.in.find('\n', start)) != std::string::npos; start = end + 1) {
+					json request = json::parse(c.in.begin() + start, c.in.begin() + end, nullptr, false);
+					json reply = request.is_object() ? handle(request) : failure("Request is not a JSON object.");
+					c.out += reply.dump();
+					c.out += '\n';
+				}
+				c.in.erase(0, start);
+				if (c.in.size() > MAX_REQUEST_BYTES) {
+					c.out += failure("Request too long.").dump() + "\n";
+					c.in.clear();
+					c.closing = true;
+				}
+			}
+			// Write replies straight away; only what the socket cannot take now waits for POLLOUT
+			while (!c.out.empty()) {
+				ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+				if (n > 0) {
+					c.out.erase(0, static_cast<size_t>(n));
+					continue;
+				}
+				if (n < 0 && errno == EINTR) {
+					continue;
+				}
+				if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+					c.out.clear();
+					c.closing = true;
+				}
+				break;
+			}
+		}
+		connections.erase(std::remove_if(connections.begin(), connections.end(), [](const Connection& c) {
+			if (c.closing && c.out.empty()) {
+				close(c.fd);
+				return true;
+			}
+			return false;
+		}), connections.end());
 
+		if (fds[0].revents & POLLIN) {
+			for (int fd; (fd = accept(listener, nullptr, nullptr)) >= 0;) {
+				if (!set_nonblocking(fd)) {
+					close(fd);
+					continue;
+				}
+				connections.push_back({ fd, std::string(), std::string() });
+			}
+		}
+	}
 
-    std::cout << std::endl;
+	for (const Connection& c : connections) {
+		close(c.fd);
+	}
+	close(listener);
+	fs::remove(socket_path, ec);
+	std::cout << "Stopped serving " << socket_path << std::endl;
+	return 0;
+}
+#endif
+
+// Prints what each --profile phase cost to stderr: a table, or records in the --format given.
+// With worker threads the phase times are summed over threads and can exceed the wall time.
+void print_profile(std::chrono::steady_clock::duration wall, OutputFormat format) {
+	double wall_ms = std::chrono::duration<double, std::milli>(wall).count();
+	double phases_ms = 0.0;
+	for (const PhaseTotals& totals : phase_totals) {
+		phases_ms += totals.nanoseconds / 1e6;
+	}
+	double other_ms = std::max(0.0, wall_ms - phases_ms);
+	std::unique_ptr<RecordWriter> records;
+	std::vector<std::vector<std::string>> table;
+	if (format != OutputFormat::Table) {
+		records.reset(new RecordWriter(std::cerr, format, { "phase", "ms", "share", "allocations", "calls" }));
+	}
+	else {
+		table.push_back({ "Phase", "Time", "Share", "Allocations", "Calls" });
+	}
+	auto row = [&](const char* name, double ms, uint64_t allocations, uint64_t calls) {
+		double share = wall_ms > 0.0 ? ms / wall_ms : 0.0;
+		if (records) {
+			records->field(name).field(ms).field(share).field(static_cast<double>(allocations)).field(static_cast<double>(calls));
+			records->end_record();
+			return;
+		}
+		char time[32];
+		char percent[16];
+		std::snprintf(time, sizeof(time), "%.3f ms", ms);
+		std::snprintf(percent, sizeof(percent), "%.1f%%", share * 100.0);
+		table.push_back({ name, time, percent, std::to_string(allocations), std::to_string(calls) });
+	};
+	for (size_t i = 0; i < PHASE_COUNT; ++i) {
+		row(PHASE_NAMES[i], phase_totals[i].nanoseconds / 1e6, phase_totals[i].allocations, phase_totals[i].calls);
+	}
+	row("other", other_ms, 0, 0);
+	row("total (wall)", wall_ms, 0, 0);
+	if (!records) {
+		std::cerr << "Profile\n";
+		write_table(std::cerr, table);
+	}
 }
 
 int main(int argc, char* argv[]) {
 	std::cout << std::fixed << std::setprecision(1);
 
+	// --format json|ndjson|csv (anywhere on the command line) switches to machine-readable output;
+	// --profile prints where the time and allocations went when the command finishes
+	OutputFormat format = OutputFormat::Table;
+	std::vector<char*> args;
+	for (int i = 0; i < argc; ++i) {
+		std::string arg = argv[i];
+		std::string name;
+		if (arg == "--profile") {
+			profiling_enabled = true;
+			continue;
+		}
+		if (arg == "--format" && i + 1 < argc) {
+			name = argv[++i];
+		}
+		else if (arg.compare(0, 9, "--format=") == 0) {
+			name = arg.substr(9);
+		}
+		else {
+			args.push_back(argv[i]);
+			continue;
+		}
+		if (!parse_output_format(name, format)) {
+			std::cerr << "Error: Unknown output format \"" << name << "\" (use table, json, ndjson or csv).\n";
+			return 1;
+		}
+	}
+	argc = static_cast<int>(args.size());
+	argv = args.data();
+
+	struct ProfileReport {
+		OutputFormat format;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		~ProfileReport() {
+			if (profiling_enabled) {
+				std::cout.flush();
+				print_profile(std::chrono::steady_clock::now() - start, format);
+			}
+		}
+	} profile_report{ format };
+
 	// Show usage if explicitly asked
 	if (argc >= 2 && std::string(argv[1]) == "usage") {
 		print_usage();
 		return 0;
 	}
 
+	// CLI: summaries for a directory or manifest of ledgers
+	if (argc >= 3 && std::string(argv[1]) == "batch") {
+		try {
+			return run_batch(argv[2], format);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << "\n";
+			return 1;
+		}
+	}
+
+	// CLI: unused PTO liability by department and cost center, as of today or a given date
+	if (argc >= 3 && std::string(argv[1]) == "liability") {
+		try {
+			return run_liability_report(argv[2], (argc >= 4) ? Date::parse(argv[3]) : today(), format);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << "\n";
+			return 1;
+		}
+	}
+
+	// CLI: Monte Carlo forecast of balances on a date
+	if (argc >= 4 && std::string(argv[1]) == "forecast") {
+		try {
+			size_t trajectories = (argc >= 5) ? static_cast<size_t>(std::atol(argv[4])) : 10000;
+			uint64_t seed = (argc >= 6) ? std::strtoull(argv[5], nullptr, 10) : 1;
+			if (trajectories < 1) {
+				std::cerr << "Error: forecast needs at least one trajectory.\n";
+				return 1;
+			}
+			return run_forecast(argv[2], Date::parse(argv[3]), trajectories, seed, (argc >= 7) ? argv[6] : "", format);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << "\n";
+			return 1;
+		}
+	}
+
+	// CLI: bulk import of leave into the ledgers of a directory or manifest
+	if (argc >= 4 && std::string(argv[1]) == "import") {
+		try {
+			return run_import(argv[2], argv[3]);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << "\n";
+			return 1;
+		}
+	}
+
+	// CLI: keep every ledger of a directory or manifest in memory and answer requests on a socket
+	if (argc >= 4 && std::string(argv[1]) == "serve") {
+		try {
+			PtoServer server(argv[2]);
+			return server.run(argv[3]);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << "\n";
+			return 1;
+		}
+	}
+
+	// CLI: convert a settings or ledger file between json, cbor and msgpack, or a ledger to
+	// and from the .ptol image
+	if (argc >= 4 && std::string(argv[1]) == "convert") {
+		try {
+			bool image = is_ledger_image_path(argv[2]) || is_ledger_image_path(argv[3]);
+			bool saved = image ? save_days_off(argv[3], LedgerFile(argv[2]).load())
+				: save_document(argv[3], load_document(argv[2]));
+			if (!saved) {
+				return 1;
+			}
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << "\n";
+			return 1;
+		}
+		std::cout << "Converted " << argv[2] << " to " << argv[3] << "\n";
+		return 0;
+	}
+
+	// CLI: time the hot paths on synthetic ledgers of growing size
+	if (argc >= 2 && std::string(argv[1]) == "bench") {
+		SyntheticLedgerSpec spec;
+		size_t max_entries = (argc >= 3) ? std::stoul(argv[2]) : 1000000;
+		spec.tenure_years = (argc >= 4) ? std::stoi(argv[3]) : spec.tenure_years;
+		spec.range_ratio = (argc >= 5) ? std::stod(argv[4]) : spec.range_ratio;
+		spec.holidays_per_year = (argc >= 6) ? std::stoi(argv[5]) : spec.holidays_per_year;
+		run_benchmarks(max_entries, spec, format);
+		return 0;
+	}
+
+	// CLI: check the date math against reference implementations
+	if (argc >= 2 && std::string(argv[1]) == "selftest") {
+		return (argc >= 3 && std::string(argv[2]) == "probe") ? run_selftest_probe() : run_selftest(argv[0]);
+	}
+
+	// CLI: compare ledger encodings on a synthetic ledger
+	if (argc >= 2 && std::string(argv[1]) == "bench_formats") {
+		bench_formats((argc >= 3) ? std::stoul(argv[2]) : 100000);
+		return 0;
+	}
 
 	// Load settings
-	std::ifstream settings_ifs(SETTINGS_FILE);
-	if (!settings_ifs) {
+	std::string settings_path = find_document(SETTINGS_FILE);
+	if (!fs::exists(settings_path)) {
 		std::cerr << "Error: Cannot open settings file.\n";
 		return 1;
 	}
-	json settings;
-	settings_ifs >> settings;
+	json settings = load_document(settings_path);
+
+	// Load or create days_off: the snapshot plus any journaled edits
+	std::string days_off_path = days_off_path_for(DAYS_OFF_FILE, settings);
+
+	// CLI: is a date off? A .ptol ledger with no pending edits answers straight from the mapping.
+	if (argc >= 3 && std::string(argv[1]) == "is_day_off" && is_ledger_image_path(days_off_path) &&
+		fs::exists(days_off_path) && !has_journaled_edits(days_off_path)) {
+		MappedLedger ledger(days_off_path);
+		print_is_day_off(argv[2], ledger.image().contains(Date::parse(argv[2])), format);
+		return 0;
+	}
+
+	LedgerFile days_off_file(days_off_path);
+	// Commands that neither list nor rewrite entries skip reading reasons
+	std::string command = (argc >= 2) ? argv[1] : "";
+	LeaveStore days_off = days_off_file.load(command != "show_hrs_on" && command != "is_day_off" && command != "optimize");
+	BusinessCalendar calendar(holiday_rules_for(settings), load_holiday_dates(HOLIDAYS_FILE));
+	DaysOffIndex index(days_off, calendar);
 
-	// Load or create days_off
-	json days_off = json::array();
-	std::ifstream days_off_ifs(DAYS_OFF_FILE);
-	if (days_off_ifs) {
-		days_off_ifs >> days_off;
+	// CLI: fold the journal back into days_off.json
+	if (argc >= 2 && std::string(argv[1]) == "compact") {
+		if (!days_off_file.compact(days_off)) {
+			return 1;
+		}
+		std::cout << "Compacted " << days_off_file.snapshot_path() << "\n";
+		return 0;
 	}
 
 	// CLI: show hours on the provided date
 	if (argc >= 3 && std::string(argv[1]) == "show_hrs_on") {
-		show_hrs_on(settings, days_off, argv[2]);
+		AccrualPlan plan(accrual_policy_for(settings), index);
+		Date through = Date::parse((argc >= 4) ? argv[3] : argv[2]);
+		BalanceTimeline timeline(plan, balance_horizon(index, through), index);
+		show_hrs_on(timeline, calendar, argv[2], (argc >= 4) ? argv[3] : "", format);
+		return 0;
+	}
+
+	// CLI: best places to book PTO days over the coming months
+	if (argc >= 3 && std::string(argv[1]) == "optimize") {
+		int budget = std::atoi(argv[2]);
+		int months = (argc >= 4) ? std::atoi(argv[3]) : 12;
+		int top_k = (argc >= 5) ? std::atoi(argv[4]) : 5;
+		int max_breaks = (argc >= 6) ? std::atoi(argv[5]) : 0;
+		if (budget < 1 || budget > 60 || months < 1 || months > 36 || top_k < 1 || max_breaks < 0) {
+			std::cerr << "Error: optimize takes 1-60 PTO days, 1-36 months, a top_k of at least 1 and max_breaks >= 0.\n";
+			return 1;
+		}
+		print_vacation_plans(settings, index, budget, months, static_cast<size_t>(top_k), max_breaks, format);
+		return 0;
+	}
+
+	// CLI: is a date off?
+	if (argc >= 3 && std::string(argv[1]) == "is_day_off") {
+		print_is_day_off(argv[2], is_day_off(index, Date::parse(argv[2])), format);
 		return 0;
 	}
 
@@ -401,7 +5811,9 @@ int main(int argc, char* argv[]) {
 		std::string date = argv[2];
 		double hours = (argc >= 4) ? std::stod(argv[3]) : 8.0;
 		std::string reason = (argc >= 5) ? argv[4] : "";
-		add_day_off(days_off, date, hours, reason);
+		if (add_day_off(days_off, index, days_off_file, date, hours, reason)) {
+			save_checkpoints(settings, days_off, calendar, days_off_path);
+		}
 		return 0;
 	}
 
@@ -411,28 +5823,33 @@ int main(int argc, char* argv[]) {
 		std::string end = argv[3];
 		double hours_per_day = (argc >= 5) ? std::stod(argv[4]) : 8.0;
 		std::string reason = (argc >= 6) ? argv[5] : "";
-		add_range_days_off(days_off, start, end, hours_per_day, reason);
+		if (add_range_days_off(days_off, index, days_off_file, start, end, hours_per_day, reason)) {
+			save_checkpoints(settings, days_off, calendar, days_off_path);
+		}
 		return 0;
 	}
 
 	// CLI: list
 	if (argc >= 2 && std::string(argv[1]) == "show_days_off") {
-		list_days_off(days_off);
+		if (format != OutputFormat::Table) {
+			write_days_off_records(days_off, calendar, format);
+		}
+		else {
+			list_days_off(days_off);
+		}
 		return 0;
 	}
 
 	// CLI: remove by date (matches any "date" or "start_date")
 	if (argc >= 3 && std::string(argv[1]) == "remove") {
 		std::string target = argv[2];
-		auto new_days_off = json::array();
-		for (const auto& entry : days_off) {
-			if ((entry.contains("date") && entry["date"] == target) ||
-				(entry.contains("start_date") && entry["start_date"] == target)) {
-				continue; // skip
+		Date day = Date::parse(target);
+		if (days_off.remove_starting_on(day) > 0) {
+			if (!days_off_file.append_remove(day, days_off)) {
+				return 1;
 			}
-			new_days_off.push_back(entry);
+			save_checkpoints(settings, days_off, calendar, days_off_path);
 		}
-		save_days_off(DAYS_OFF_FILE, new_days_off);
 		std::cout << "Removed entries for date: " << target << "\n";
 		return 0;
 	}
@@ -445,7 +5862,7 @@ int main(int argc, char* argv[]) {
 
 	// Default behavior: calculate PTO
 	if (argc == 1) {
-		print_pto_summary(settings, days_off);
+		print_pto_summary(settings, days_off, index, checkpoint_path_for(days_off_path), format);
 		return 0;
 	}
 	